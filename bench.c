@@ -0,0 +1,334 @@
+#include "header.h"
+#include <glib/gstdio.h>
+#include <errno.h>
+
+// Headless benchmarks of the editor's core operations; run under Xvfb or GDK_BACKEND=broadway
+
+#define BENCH_MIN_RUNS 3
+#define BENCH_MAX_RUNS 1000
+#define BENCH_MIN_TIME (200 * 1000)         // Keep repeating cheap operations for at least this long
+#define BENCH_MAX_TIME (5 * 1000 * 1000)    // Stop repeating expensive ones after this long
+#define BENCH_CHUNK (1024 * 1024)
+#define BENCH_LONG_LINE (1024 * 1024)       // Line length for the long-line shape
+
+CodeEditor *editor = NULL;
+
+typedef enum {
+    SHAPE_SHORT,        // Many 60-byte lines
+    SHAPE_LONG          // Few 1 MB lines
+} BenchShape;
+
+static const gchar *shape_names[] = { "short", "long" };
+static const gchar *default_sizes = "1K,1M,64M,1G";
+static const gchar *filler = "the quick brown fox jumps over the lazy dog while codepad ";
+
+typedef struct {
+    const gchar *path;          // File the current case works on
+    gchar *save_path;
+    gboolean painted;
+    GString *json;
+    guint64 size;
+    BenchShape shape;
+    gboolean first_result;
+} BenchState;
+
+static BenchState bench;
+
+// "1K", "64M", "1G" or plain bytes
+static guint64 parse_size(const gchar *text) {
+    gchar *end;
+    guint64 value = g_ascii_strtoull(text, &end, 10);
+
+    switch (g_ascii_toupper(*end)) {
+        case 'K': return value << 10;
+        case 'M': return value << 20;
+        case 'G': return value << 30;
+        default: return value;
+    }
+}
+
+static gboolean generate_file(const gchar *path, guint64 size, BenchShape shape, GError **error) {
+    FILE *file = g_fopen(path, "wb");
+    gchar *chunk = g_malloc(BENCH_CHUNK);
+    gsize filler_len = strlen(filler);
+    guint64 column = 0;
+
+    if (!file) {
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno), "Could not create %s", path);
+        g_free(chunk);
+        return FALSE;
+    }
+
+    // Same text in both shapes, only the line breaks move
+    guint64 line_length = shape == SHAPE_SHORT ? filler_len + 1 : BENCH_LONG_LINE;
+    for (guint64 written = 0; written < size;) {
+        gsize n = (gsize) MIN((guint64) BENCH_CHUNK, size - written);
+        for (gsize i = 0; i < n; i++) {
+            if (column + 1 == line_length) {
+                chunk[i] = '\n';
+                column = 0;
+            } else {
+                chunk[i] = filler[column++ % filler_len];
+            }
+        }
+        if (fwrite(chunk, 1, n, file) != n) {
+            g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno), "Could not write %s", path);
+            fclose(file);
+            g_free(chunk);
+            return FALSE;
+        }
+        written += n;
+    }
+    fclose(file);
+    g_free(chunk);
+    return TRUE;
+}
+
+static void pump_while(gboolean (*busy)(void)) {
+    while (busy()) {
+        g_main_context_iteration(NULL, TRUE);
+    }
+}
+
+// Lets deferred work (highlighting, refreshes) finish outside the timed region
+static void settle(void) {
+    while (g_main_context_iteration(NULL, FALSE)) {
+    }
+}
+
+static gboolean loading(void) {
+    return editor->loading;
+}
+
+static gboolean awaiting_paint(void) {
+    return !bench.painted;
+}
+
+static void on_bench_after_paint(GdkFrameClock *clock, gpointer data) {
+    bench.painted = TRUE;
+}
+
+static gint compare_samples(gconstpointer a, gconstpointer b) {
+    gint64 sa = *(const gint64 *) a, sb = *(const gint64 *) b;
+    return sa < sb ? -1 : sa > sb;
+}
+
+// Repeats op until the timing is stable enough, then appends one JSON result
+static void run(const gchar *name, void (*op)(void)) {
+    GArray *samples = g_array_new(FALSE, FALSE, sizeof(gint64));
+    gint64 total = 0;
+
+    while (samples->len < BENCH_MAX_RUNS && total < BENCH_MAX_TIME &&
+           (samples->len < BENCH_MIN_RUNS || total < BENCH_MIN_TIME)) {
+        gint64 start = g_get_monotonic_time();
+        op();
+        gint64 elapsed = g_get_monotonic_time() - start;
+        g_array_append_val(samples, elapsed);
+        total += elapsed;
+    }
+    g_array_sort(samples, compare_samples);
+
+    g_string_append_printf(bench.json, "%s\n{\"name\":\"%s\",\"size\":%" G_GUINT64_FORMAT ",\"shape\":\"%s\","
+                           "\"runs\":%u,\"min_us\":%" G_GINT64_FORMAT ",\"median_us\":%" G_GINT64_FORMAT
+                           ",\"mean_us\":%" G_GINT64_FORMAT ",\"max_us\":%" G_GINT64_FORMAT "}",
+                           bench.first_result ? "" : ",", name, bench.size, shape_names[bench.shape], samples->len,
+                           g_array_index(samples, gint64, 0), g_array_index(samples, gint64, samples->len / 2),
+                           total / samples->len, g_array_index(samples, gint64, samples->len - 1));
+    bench.first_result = FALSE;
+    g_printerr("  %-20s %10.3f ms median over %u runs\n", name,
+               g_array_index(samples, gint64, samples->len / 2) / 1000.0, samples->len);
+    g_array_free(samples, TRUE);
+}
+
+// Through the same path as File > Open: the mapped viewer past the threshold, otherwise the streaming loader
+static void op_open(void) {
+    open_file(bench.path);
+    pump_while(loading);
+}
+
+static void op_line_numbers(void) {
+    update_line_numbers();
+}
+
+static void op_status_bar(void) {
+    update_status_bar();
+}
+
+static void op_paint(void) {
+    bench.painted = FALSE;
+    gtk_widget_queue_draw(editor->text_view);
+    pump_while(awaiting_paint);
+}
+
+// The search kernel over the whole file, with a needle that never matches
+static void op_search_kernel(void) {
+    GMappedFile *mapped = g_mapped_file_new(bench.path, FALSE, NULL);
+    const gchar *needle = "codepad-bench-needle";
+
+    if (mapped) {
+        search_find(g_mapped_file_get_contents(mapped), g_mapped_file_get_length(mapped),
+                    needle, strlen(needle), FALSE);
+        g_mapped_file_unref(mapped);
+    }
+}
+
+// Find bar search on the buffer: background scan and highlighting of every match
+static void op_search(void) {
+    search_clear();
+    search_set_query("lazy", TRUE, FALSE);
+    pump_while(search_in_progress);
+    flush_refresh();
+}
+
+// One keystroke at the cursor and the refresh it triggers
+static void op_edit(void) {
+    GtkTextIter iter;
+
+    gtk_text_buffer_get_iter_at_mark(editor->buffer, &iter, gtk_text_buffer_get_insert(editor->buffer));
+    gtk_text_buffer_begin_user_action(editor->buffer);
+    gtk_text_buffer_insert(editor->buffer, &iter, "x", 1);
+    gtk_text_buffer_end_user_action(editor->buffer);
+    flush_refresh();
+}
+
+static void op_save(void) {
+    save_file_async(bench.save_path, FALSE);
+    pump_while(save_in_progress);
+}
+
+static void run_case(const gchar *dir, guint64 size, BenchShape shape) {
+    gchar *basename = g_strdup_printf("bench-%" G_GUINT64_FORMAT "-%s.txt", size, shape_names[shape]);
+    gchar *path = g_build_filename(dir, basename, NULL);
+    GError *error = NULL;
+
+    bench.size = size;
+    bench.shape = shape;
+    bench.path = path;
+    bench.save_path = g_strconcat(path, ".saved", NULL);
+
+    g_printerr("%" G_GUINT64_FORMAT " bytes, %s lines\n", size, shape_names[shape]);
+    if (!generate_file(path, size, shape, &error)) {
+        g_printerr("  skipped: %s\n", error->message);
+        g_clear_error(&error);
+    } else {
+        run("open", op_open);
+        settle();
+        run("update_line_numbers", op_line_numbers);
+        run("update_status_bar", op_status_bar);
+        run("paint", op_paint);
+        run("search_find", op_search_kernel);
+
+        // The viewer is read-only and searches the mapping itself
+        if (!viewer_is_active()) {
+            run("search", op_search);
+            search_clear();
+            run("edit", op_edit);
+            settle();
+            run("save", op_save);
+        }
+    }
+
+    g_unlink(bench.save_path);
+    g_unlink(path);
+    g_free(bench.save_path);
+    g_free(path);
+    g_free(basename);
+}
+
+static gboolean write_results(const gchar *output) {
+    GError *error = NULL;
+
+    g_string_append(bench.json, "\n]}\n");
+    if (!output) {
+        fputs(bench.json->str, stdout);
+        return TRUE;
+    }
+    if (!g_file_set_contents(output, bench.json->str, bench.json->len, &error)) {
+        g_printerr("Could not write %s: %s\n", output, error->message);
+        g_error_free(error);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+int main(int argc, char *argv[]) {
+    gchar *sizes = NULL, *shapes = NULL, *output = NULL, *label = NULL;
+    GOptionEntry entries[] = {
+        { "sizes", 0, 0, G_OPTION_ARG_STRING, &sizes, "File sizes to test (default 1K,1M,64M,1G)", "LIST" },
+        { "shapes", 0, 0, G_OPTION_ARG_STRING, &shapes, "Line shapes to test (default short,long)", "LIST" },
+        { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output, "Write JSON results here instead of stdout", "FILE" },
+        { "label", 0, 0, G_OPTION_ARG_STRING, &label, "Recorded with the results, e.g. a commit hash", "TEXT" },
+        { NULL }
+    };
+    GError *error = NULL;
+
+    if (!gtk_init_with_args(&argc, &argv, NULL, entries, NULL, &error)) {
+        g_printerr("%s\n", error ? error->message : "Cannot open display");
+        return 1;
+    }
+
+    // Same setup as main.c, minus the session and the terminal shell
+    editor = g_new0(CodeEditor, 1);
+    editor->zoom_level = 12;
+    editor->pending_goto_line = -1;
+    const gchar *threshold_mb = g_getenv("CODEPAD_LARGE_FILE_MB");
+    editor->large_file_threshold = (threshold_mb ? g_ascii_strtoull(threshold_mb, NULL, 10) : 256) * 1024 * 1024;
+    editor->document_budget = 256 * 1024 * 1024;
+    editor->undo_budget = 64 * 1024 * 1024;
+
+    setup_ui();
+    setup_theme();
+    setup_editor();
+    setup_journal();
+    setup_documents();
+    setup_highlight();
+    setup_viewer();
+    setup_search();
+    setup_find_files();
+    setup_terminal();
+    setup_perf();
+    setup_callbacks();
+    apply_theme();
+    gtk_widget_show_all(editor->window);
+    gtk_widget_hide(editor->terminal_container);
+    g_signal_connect(gtk_widget_get_frame_clock(editor->window), "after-paint",
+                     G_CALLBACK(on_bench_after_paint), NULL);
+    pump_while(awaiting_paint);
+    settle();
+
+    gchar *dir = g_dir_make_tmp("codepad-bench-XXXXXX", &error);
+    if (!dir) {
+        g_printerr("%s\n", error->message);
+        return 1;
+    }
+
+    bench.first_result = TRUE;
+    bench.json = g_string_new("{");
+    if (label) {
+        gchar *escaped = g_strescape(label, NULL);
+        g_string_append_printf(bench.json, "\"label\":\"%s\",", escaped);
+        g_free(escaped);
+    }
+    g_string_append_printf(bench.json, "\"gtk\":\"%u.%u.%u\",\"display\":\"%s\",\"results\":[",
+                           gtk_get_major_version(), gtk_get_minor_version(), gtk_get_micro_version(),
+                           G_OBJECT_TYPE_NAME(gdk_display_get_default()));
+
+    gchar **size_list = g_strsplit(sizes ? sizes : default_sizes, ",", -1);
+    gchar **shape_list = g_strsplit(shapes ? shapes : "short,long", ",", -1);
+    for (gint i = 0; size_list[i]; i++) {
+        for (gint j = 0; shape_list[j]; j++) {
+            BenchShape shape = g_strcmp0(shape_list[j], "long") == 0 ? SHAPE_LONG : SHAPE_SHORT;
+            run_case(dir, parse_size(size_list[i]), shape);
+        }
+    }
+
+    // The edits above must not come back as recovered tabs in the editor
+    journal_shutdown();
+    gboolean ok = write_results(output);
+    g_rmdir(dir);
+    g_strfreev(size_list);
+    g_strfreev(shape_list);
+    g_string_free(bench.json, TRUE);
+    g_free(dir);
+    return ok ? 0 : 1;
+}
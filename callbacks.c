@@ -1,18 +1,44 @@
 #include "header.h"
-
-// Function prototypes
-void on_save_as_file(GtkButton *button, gpointer data);
+#include <glib/gstdio.h>
 
 void on_new_file(GtkButton *button, gpointer data) {
-    gtk_text_buffer_set_text(editor->buffer, "", 0);
-    if (editor->current_file) {
-        g_free(editor->current_file);
-        editor->current_file = NULL;
+    documents_new();
+}
+
+void on_close_tab(GtkButton *button, gpointer data) {
+    documents_close_current();
+}
+
+// The shell and text entries have their own meaning for some editor shortcuts (Ctrl+W deletes a word)
+static gboolean focus_owns_key(void) {
+    GtkWidget *focus = gtk_window_get_focus(GTK_WINDOW(editor->window));
+    return focus && (VTE_IS_TERMINAL(focus) || GTK_IS_EDITABLE(focus));
+}
+
+// Accelerator handlers return FALSE to pass the key on to the focused widget
+static gboolean on_close_tab_key(void) {
+    if (focus_owns_key()) {
+        return FALSE;
     }
-    editor->is_modified = FALSE;
-    update_window_title();
-    update_status_bar();
-    update_line_numbers();
+    documents_close_current();
+    return TRUE;
+}
+
+// Ctrl+Z suspends the shell's job and Ctrl+Y yanks, so undo and redo only act outside the terminal
+static gboolean on_undo_key(void) {
+    if (focus_owns_key()) {
+        return FALSE;
+    }
+    undo_last();
+    return TRUE;
+}
+
+static gboolean on_redo_key(void) {
+    if (focus_owns_key()) {
+        return FALSE;
+    }
+    redo_last();
+    return TRUE;
 }
 
 void on_open_file(GtkButton *button, gpointer data) {
@@ -32,63 +58,77 @@ void on_open_file(GtkButton *button, gpointer data) {
 
     if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT) {
         char *filename = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dialog));
-        char *contents;
-        gsize length;
-        GError *error = NULL;
-
-        if (g_file_get_contents(filename, &contents, &length, &error)) {
-            gtk_text_buffer_set_text(editor->buffer, contents, length);
-            g_free(editor->current_file);
-            editor->current_file = g_strdup(filename);
-            editor->is_modified = FALSE;
-            g_free(contents);
-            update_window_title();
-            update_status_bar();
-            update_line_numbers();
-        } else {
-            GtkWidget *error_dialog = gtk_message_dialog_new(GTK_WINDOW(editor->window),
-                                             GTK_DIALOG_DESTROY_WITH_PARENT,
-                                             GTK_MESSAGE_ERROR,
-                                             GTK_BUTTONS_CLOSE,
-                                             "Error opening file: %s", error->message);
-            gtk_dialog_run(GTK_DIALOG(error_dialog));
-            gtk_widget_destroy(error_dialog);
-            g_error_free(error);
-        }
+        documents_open(filename);
         g_free(filename);
     }
     gtk_widget_destroy(dialog);
 }
 
-void on_save_file(GtkButton *button, gpointer data) {
-    if (!editor->current_file) {
-        on_save_as_file(button, data);
-        return;
-    }
-
-    GtkTextIter start, end;
-    gtk_text_buffer_get_bounds(editor->buffer, &start, &end);
-    gchar *text = gtk_text_buffer_get_text(editor->buffer, &start, &end, FALSE);
-
+static gboolean read_into_view(const gchar *filename, gboolean reload) {
+    GStatBuf st;
     GError *error = NULL;
-    if (g_file_set_contents(editor->current_file, text, -1, &error)) {
-        editor->is_modified = FALSE;
-        update_window_title();
-        update_status_bar();
-    } else {
+
+    // Large files are paged in from a mapping instead of being copied into the buffer
+    if (g_stat(filename, &st) == 0 && (guint64) st.st_size >= editor->large_file_threshold) {
+        if (viewer_open(filename, &error)) {
+            // Nothing in the viewer can be edited, so no earlier edit can be undone into it
+            undo_clear();
+            return TRUE;
+        }
         GtkWidget *error_dialog = gtk_message_dialog_new(GTK_WINDOW(editor->window),
                                          GTK_DIALOG_DESTROY_WITH_PARENT,
                                          GTK_MESSAGE_ERROR,
                                          GTK_BUTTONS_CLOSE,
-                                         "Error saving file: %s", error->message);
+                                         "Error opening file: %s", error->message);
         gtk_dialog_run(GTK_DIALOG(error_dialog));
         gtk_widget_destroy(error_dialog);
         g_error_free(error);
+        return FALSE;
     }
-    g_free(text);
+
+    viewer_close();
+    highlight_set_file(filename);
+    if (reload) {
+        undo_begin_reload();
+    } else {
+        undo_clear();
+    }
+    load_file_async(filename);
+    return TRUE;
 }
 
-void on_save_as_file(GtkButton *button, gpointer data) {
+// Starts loading filename into the shown tab; FALSE if it could not be opened
+gboolean open_file(const gchar *filename) {
+    Journal *journal = journal_get_active();
+    // Reading the shown file again can be undone; any other file starts a new history
+    gboolean reload = !editor->loading && !editor->unloaded && !viewer_is_active() &&
+                      g_strcmp0(editor->current_file, filename) == 0;
+
+    // Whatever is read in replaces the text the recovery journal refers to
+    journal_discard(journal);
+    journal_set_active(NULL);
+    gboolean opened = read_into_view(filename, reload);
+    journal_set_active(journal);
+    return opened;
+}
+
+// Shows filename in its tab, opening one if needed, then moves to line
+void open_file_at_line(const gchar *filename, gint64 line) {
+    documents_open(filename);
+    if (editor->loading) {
+        editor->pending_goto_line = line;
+    } else {
+        goto_line(line);
+    }
+}
+
+void on_cancel_load(GtkButton *button, gpointer data) {
+    cancel_file_load();
+}
+
+// Asks for a filename and makes it the current file; FALSE if the user cancelled
+static gboolean choose_save_filename(void) {
+    gboolean chosen = FALSE;
     GtkWidget *dialog = gtk_file_chooser_dialog_new("Save File",
                                     GTK_WINDOW(editor->window),
                                     GTK_FILE_CHOOSER_ACTION_SAVE,
@@ -101,10 +141,38 @@ void on_save_as_file(GtkButton *button, gpointer data) {
         char *filename = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dialog));
         g_free(editor->current_file);
         editor->current_file = g_strdup(filename);
+        highlight_set_file(filename);
         g_free(filename);
-        on_save_file(button, data);
+        chosen = TRUE;
     }
     gtk_widget_destroy(dialog);
+    return chosen;
+}
+
+// Starts a background save; FALSE if nothing was started
+static gboolean save_document(gboolean close_after) {
+    // The buffer only holds part of the file until loading finishes, and none of it if loading failed
+    if (editor->loading || editor->unloaded || viewer_is_active()) {
+        return FALSE;
+    }
+    if (!editor->current_file && !choose_save_filename()) {
+        return FALSE;
+    }
+    save_file_async(editor->current_file, close_after);
+    return TRUE;
+}
+
+void on_save_file(GtkButton *button, gpointer data) {
+    save_document(FALSE);
+}
+
+void on_save_as_file(GtkButton *button, gpointer data) {
+    if (editor->loading || editor->unloaded || viewer_is_active()) {
+        return;
+    }
+    if (choose_save_filename()) {
+        save_document(FALSE);
+    }
 }
 
 void on_quit(GtkButton *button, gpointer data) {
@@ -112,16 +180,22 @@ void on_quit(GtkButton *button, gpointer data) {
 }
 
 void on_cut(GtkButton *button, gpointer data) {
+    if (viewer_is_active()) {
+        return;
+    }
     GtkClipboard *clipboard = gtk_clipboard_get(GDK_SELECTION_CLIPBOARD);
     gtk_text_buffer_cut_clipboard(editor->buffer, clipboard, TRUE);
 }
 
 void on_copy(GtkButton *button, gpointer data) {
     GtkClipboard *clipboard = gtk_clipboard_get(GDK_SELECTION_CLIPBOARD);
-    gtk_text_buffer_copy_clipboard(editor->buffer, clipboard);
+    gtk_text_buffer_copy_clipboard(gtk_text_view_get_buffer(GTK_TEXT_VIEW(editor->text_view)), clipboard);
 }
 
 void on_paste(GtkButton *button, gpointer data) {
+    if (viewer_is_active()) {
+        return;
+    }
     GtkClipboard *clipboard = gtk_clipboard_get(GDK_SELECTION_CLIPBOARD);
     gtk_text_buffer_paste_clipboard(editor->buffer, clipboard, NULL, TRUE);
 }
@@ -134,28 +208,103 @@ void on_find(GtkButton *button, gpointer data) {
     }
 }
 
-void on_search_changed(GtkSearchEntry *entry, gpointer data) {
-    const gchar *search_text = gtk_entry_get_text(GTK_ENTRY(entry));
-    if (strlen(search_text) > 0) {
-        GtkTextIter start, match_start, match_end;
-        gtk_text_buffer_get_start_iter(editor->buffer, &start);
-        if (gtk_text_iter_forward_search(&start, search_text, GTK_TEXT_SEARCH_TEXT_ONLY,
-                                         &match_start, &match_end, NULL)) {
-            gtk_text_buffer_select_range(editor->buffer, &match_start, &match_end);
-            gtk_text_view_scroll_to_iter(GTK_TEXT_VIEW(editor->text_view),
-                                         &match_start, 0.0, FALSE, 0.0, 0.0);
+static void run_search(void) {
+    const gchar *search_text = gtk_entry_get_text(GTK_ENTRY(editor->search_entry));
+    gboolean match_case = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(editor->match_case_button));
+    gboolean use_regex = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(editor->regex_button));
+    if (viewer_is_active()) {
+        GRegex *regex = NULL;
+        if (use_regex && *search_text && !(regex = search_compile_regex(search_text, match_case, G_REGEX_RAW, NULL))) {
+            return;
+        }
+        viewer_search(search_text, match_case, regex);
+        if (regex) {
+            g_regex_unref(regex);
         }
+        return;
     }
+    search_set_query(search_text, match_case, use_regex);
+}
+
+void on_search_changed(GtkSearchEntry *entry, gpointer data) {
+    PERF_TIME(PERF_SEARCH_CHANGED, run_search());
+}
+
+void on_search_option_toggled(GtkToggleButton *button, gpointer data) {
+    on_search_changed(GTK_SEARCH_ENTRY(editor->search_entry), NULL);
+}
+
+void on_replace_all(GtkButton *button, gpointer data) {
+    if (viewer_is_active() || editor->loading) {
+        return;
+    }
+    search_replace_all(gtk_entry_get_text(GTK_ENTRY(editor->replace_entry)));
+}
+
+void on_find_next(GtkButton *button, gpointer data) {
+    if (viewer_is_active()) {
+        viewer_search_next(FALSE);
+        return;
+    }
+    search_next(FALSE);
+}
+
+void on_find_previous(GtkButton *button, gpointer data) {
+    if (viewer_is_active()) {
+        viewer_search_next(TRUE);
+        return;
+    }
+    search_next(TRUE);
+}
+
+void on_search_mode_changed(GObject *search_bar, GParamSpec *pspec, gpointer data) {
+    if (!gtk_search_bar_get_search_mode(GTK_SEARCH_BAR(search_bar))) {
+        search_clear();
+    }
+}
+
+void goto_line(gint64 line) {
+    if (viewer_is_active()) {
+        viewer_goto_line(line);
+        return;
+    }
+
+    GtkTextIter iter;
+    gtk_text_buffer_get_iter_at_line(editor->buffer, &iter, (gint) line);
+    gtk_text_buffer_place_cursor(editor->buffer, &iter);
+    gtk_text_view_scroll_to_mark(GTK_TEXT_VIEW(editor->text_view),
+                                 gtk_text_buffer_get_insert(editor->buffer), 0.0, TRUE, 0.0, 0.3);
+}
+
+void on_goto_line(GtkButton *button, gpointer data) {
+    gint64 total_lines = viewer_is_active() ? viewer_line_count() : editor->stats.lines;
+    GtkWidget *dialog = gtk_dialog_new_with_buttons("Go to Line",
+                                    GTK_WINDOW(editor->window),
+                                    GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+                                    "_Cancel", GTK_RESPONSE_CANCEL,
+                                    "_Go", GTK_RESPONSE_ACCEPT,
+                                    NULL);
+    gtk_dialog_set_default_response(GTK_DIALOG(dialog), GTK_RESPONSE_ACCEPT);
+
+    GtkWidget *spin = gtk_spin_button_new_with_range(1, MAX(total_lines, 1), 1);
+    gtk_entry_set_activates_default(GTK_ENTRY(spin), TRUE);
+    gtk_widget_set_margin_start(spin, 10);
+    gtk_widget_set_margin_end(spin, 10);
+    gtk_container_add(GTK_CONTAINER(gtk_dialog_get_content_area(GTK_DIALOG(dialog))), spin);
+    gtk_widget_show_all(dialog);
+
+    if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT) {
+        goto_line((gint64) gtk_spin_button_get_value(GTK_SPIN_BUTTON(spin)) - 1);
+    }
+    gtk_widget_destroy(dialog);
 }
 
 void on_zoom_in(GtkButton *button, gpointer data) {
-    editor->zoom_level = MIN(editor->zoom_level + 2, 24);
-    apply_theme();
+    set_zoom(editor->zoom_level + 2);
 }
 
 void on_zoom_out(GtkButton *button, gpointer data) {
-    editor->zoom_level = MAX(editor->zoom_level - 2, 8);
-    apply_theme();
+    set_zoom(editor->zoom_level - 2);
 }
 
 void on_toggle_theme(GtkButton *button, gpointer data) {
@@ -169,6 +318,7 @@ void on_toggle_terminal(GtkButton *button, gpointer data) {
         gtk_button_set_label(GTK_BUTTON(editor->terminal_button), "Show Terminal");
         editor->terminal_visible = FALSE;
     } else {
+        terminal_ensure();
         gtk_widget_show_all(editor->terminal_container);
         gtk_button_set_label(GTK_BUTTON(editor->terminal_button), "Hide Terminal");
         editor->terminal_visible = TRUE;
@@ -187,13 +337,44 @@ void on_about(GtkButton *button, gpointer data) {
 }
 
 void on_text_changed(GtkTextBuffer *buffer, gpointer data) {
-    editor->is_modified = TRUE;
-    update_window_title();
-    update_status_bar();
-    update_line_numbers();
+    guint flags = REFRESH_STATUS | REFRESH_GUTTER;
+    gint64 perf_start = perf_begin();
+    editor->change_seq++;
+    search_document_changed();
+    if (!editor->is_modified && !editor->loading) {
+        editor->is_modified = TRUE;
+        flags |= REFRESH_TITLE;
+    }
+    schedule_refresh(flags);
+    perf_end(PERF_TEXT_CHANGED, perf_start);
+}
+
+void on_mark_set(GtkTextBuffer *buffer, GtkTextIter *location, GtkTextMark *mark, gpointer data) {
+    if (mark == gtk_text_buffer_get_insert(buffer)) {
+        PERF_TIME(PERF_MARK_SET, schedule_refresh(REFRESH_STATUS); session_changed());
+    }
 }
 
 gboolean on_window_delete(GtkWidget *widget, GdkEvent *event, gpointer data) {
+    guint unsaved = documents_unsaved_count();
+    if (unsaved > 0) {
+        GtkWidget *dialog = gtk_message_dialog_new(GTK_WINDOW(editor->window),
+                                           GTK_DIALOG_MODAL,
+                                           GTK_MESSAGE_QUESTION,
+                                           GTK_BUTTONS_NONE,
+                                           "%u other tab%s ha%s unsaved changes. Close anyway?",
+                                           unsaved, unsaved == 1 ? "" : "s", unsaved == 1 ? "s" : "ve");
+        gtk_dialog_add_buttons(GTK_DIALOG(dialog),
+                               "_Cancel", GTK_RESPONSE_CANCEL,
+                               "Close _Without Saving", GTK_RESPONSE_CLOSE,
+                               NULL);
+        gint response = gtk_dialog_run(GTK_DIALOG(dialog));
+        gtk_widget_destroy(dialog);
+        if (response != GTK_RESPONSE_CLOSE) {
+            return TRUE;
+        }
+    }
+
     if (editor->is_modified) {
         GtkWidget *dialog = gtk_message_dialog_new(GTK_WINDOW(editor->window),
                                            GTK_DIALOG_MODAL,
@@ -209,8 +390,9 @@ gboolean on_window_delete(GtkWidget *widget, GdkEvent *event, gpointer data) {
         gtk_widget_destroy(dialog);
 
         if (response == GTK_RESPONSE_YES) {
-            on_save_file(NULL, NULL);
-            return FALSE;
+            // The window closes once the background save has landed
+            save_document(TRUE);
+            return TRUE;
         } else if (response == GTK_RESPONSE_CANCEL) {
             return TRUE;
         }
@@ -221,9 +403,16 @@ gboolean on_window_delete(GtkWidget *widget, GdkEvent *event, gpointer data) {
 void setup_callbacks(void) {
     // Connect signals
     g_signal_connect(editor->buffer, "changed", G_CALLBACK(on_text_changed), NULL);
+    g_signal_connect(editor->buffer, "mark-set", G_CALLBACK(on_mark_set), NULL);
     g_signal_connect(editor->window, "delete-event", G_CALLBACK(on_window_delete), NULL);
+    g_signal_connect_swapped(editor->window, "destroy", G_CALLBACK(session_close), NULL);
     g_signal_connect(editor->window, "destroy", G_CALLBACK(gtk_main_quit), NULL);
     g_signal_connect(editor->search_entry, "search-changed", G_CALLBACK(on_search_changed), NULL);
+    g_signal_connect(editor->match_case_button, "toggled", G_CALLBACK(on_search_option_toggled), NULL);
+    g_signal_connect(editor->regex_button, "toggled", G_CALLBACK(on_search_option_toggled), NULL);
+    g_signal_connect(editor->replace_entry, "activate", G_CALLBACK(on_replace_all), NULL);
+    g_signal_connect(editor->search_bar, "notify::search-mode-enabled", G_CALLBACK(on_search_mode_changed), NULL);
+    g_signal_connect(editor->load_cancel_button, "clicked", G_CALLBACK(on_cancel_load), NULL);
 
     // Setup keyboard shortcuts
     GtkAccelGroup *accel_group = gtk_accel_group_new();
@@ -236,8 +425,16 @@ void setup_callbacks(void) {
                            g_cclosure_new_swap(G_CALLBACK(on_open_file), NULL, NULL));
     gtk_accel_group_connect(accel_group, GDK_KEY_s, GDK_CONTROL_MASK, 0,
                            g_cclosure_new_swap(G_CALLBACK(on_save_file), NULL, NULL));
+    gtk_accel_group_connect(accel_group, GDK_KEY_w, GDK_CONTROL_MASK, 0,
+                           g_cclosure_new_swap(G_CALLBACK(on_close_tab_key), NULL, NULL));
 
     // Edit operations
+    gtk_accel_group_connect(accel_group, GDK_KEY_z, GDK_CONTROL_MASK, 0,
+                           g_cclosure_new_swap(G_CALLBACK(on_undo_key), NULL, NULL));
+    gtk_accel_group_connect(accel_group, GDK_KEY_z, GDK_CONTROL_MASK | GDK_SHIFT_MASK, 0,
+                           g_cclosure_new_swap(G_CALLBACK(on_redo_key), NULL, NULL));
+    gtk_accel_group_connect(accel_group, GDK_KEY_y, GDK_CONTROL_MASK, 0,
+                           g_cclosure_new_swap(G_CALLBACK(on_redo_key), NULL, NULL));
     gtk_accel_group_connect(accel_group, GDK_KEY_x, GDK_CONTROL_MASK, 0,
                            g_cclosure_new_swap(G_CALLBACK(on_cut), NULL, NULL));
     gtk_accel_group_connect(accel_group, GDK_KEY_c, GDK_CONTROL_MASK, 0,
@@ -246,6 +443,14 @@ void setup_callbacks(void) {
                            g_cclosure_new_swap(G_CALLBACK(on_paste), NULL, NULL));
     gtk_accel_group_connect(accel_group, GDK_KEY_f, GDK_CONTROL_MASK, 0,
                            g_cclosure_new_swap(G_CALLBACK(on_find), NULL, NULL));
+    gtk_accel_group_connect(accel_group, GDK_KEY_f, GDK_CONTROL_MASK | GDK_SHIFT_MASK, 0,
+                           g_cclosure_new_swap(G_CALLBACK(toggle_find_files), NULL, NULL));
+    gtk_accel_group_connect(accel_group, GDK_KEY_F3, 0, 0,
+                           g_cclosure_new_swap(G_CALLBACK(on_find_next), NULL, NULL));
+    gtk_accel_group_connect(accel_group, GDK_KEY_F3, GDK_SHIFT_MASK, 0,
+                           g_cclosure_new_swap(G_CALLBACK(on_find_previous), NULL, NULL));
+    gtk_accel_group_connect(accel_group, GDK_KEY_g, GDK_CONTROL_MASK, 0,
+                           g_cclosure_new_swap(G_CALLBACK(on_goto_line), NULL, NULL));
 
     // Terminal toggle
     gtk_accel_group_connect(accel_group, GDK_KEY_t, GDK_CONTROL_MASK, 0,
@@ -256,4 +461,8 @@ void setup_callbacks(void) {
                            g_cclosure_new_swap(G_CALLBACK(on_zoom_in), NULL, NULL));
     gtk_accel_group_connect(accel_group, GDK_KEY_minus, GDK_CONTROL_MASK, 0,
                            g_cclosure_new_swap(G_CALLBACK(on_zoom_out), NULL, NULL));
+
+    // Latency overlay
+    gtk_accel_group_connect(accel_group, GDK_KEY_p, GDK_CONTROL_MASK | GDK_SHIFT_MASK, 0,
+                           g_cclosure_new_swap(G_CALLBACK(toggle_perf_overlay), NULL, NULL));
 }
\ No newline at end of file
@@ -0,0 +1,383 @@
+#include "header.h"
+
+#define DOC_CHUNK_SIZE (64 * 1024)
+
+// Append-only storage for inserted text; bytes below `used` never change once written
+typedef struct {
+    gint ref_count;
+    gsize capacity;
+    gsize used;
+    gchar data[];
+} DocChunk;
+
+typedef struct {
+    DocChunk *chunk;
+    gsize offset;
+    gsize bytes;
+    gsize chars;
+} DocPiece;
+
+// An immutable piece list while shared; the document clones it before editing a shared one
+struct _DocSnapshot {
+    gint ref_count;
+    DocPiece *pieces;
+    guint n_pieces;
+    guint capacity;
+    gsize bytes;
+    gsize chars;
+};
+
+struct _Document {
+    DocSnapshot *current;
+    DocChunk *add;
+
+    // A piece near the last edit and its first char, kept valid across edits so nearby lookups walk
+    // only the pieces in between
+    guint cached_piece;
+    gsize cached_start;
+};
+
+static DocChunk *chunk_new(gsize capacity) {
+    DocChunk *chunk = g_malloc(sizeof(DocChunk) + capacity);
+    chunk->ref_count = 1;
+    chunk->capacity = capacity;
+    chunk->used = 0;
+    return chunk;
+}
+
+static void chunk_unref(DocChunk *chunk) {
+    if (g_atomic_int_dec_and_test(&chunk->ref_count)) {
+        g_free(chunk);
+    }
+}
+
+static DocSnapshot *snapshot_new(guint capacity) {
+    DocSnapshot *snapshot = g_new0(DocSnapshot, 1);
+    snapshot->ref_count = 1;
+    snapshot->capacity = MAX(capacity, 16);
+    snapshot->pieces = g_new(DocPiece, snapshot->capacity);
+    return snapshot;
+}
+
+DocSnapshot *doc_snapshot_ref(DocSnapshot *snapshot) {
+    g_atomic_int_inc(&snapshot->ref_count);
+    return snapshot;
+}
+
+void doc_snapshot_unref(DocSnapshot *snapshot) {
+    if (!g_atomic_int_dec_and_test(&snapshot->ref_count)) {
+        return;
+    }
+    for (guint i = 0; i < snapshot->n_pieces; i++) {
+        chunk_unref(snapshot->pieces[i].chunk);
+    }
+    g_free(snapshot->pieces);
+    g_free(snapshot);
+}
+
+gsize doc_snapshot_get_length(DocSnapshot *snapshot) {
+    return snapshot->bytes;
+}
+
+gsize doc_snapshot_get_char_count(DocSnapshot *snapshot) {
+    return snapshot->chars;
+}
+
+guint doc_snapshot_get_n_pieces(DocSnapshot *snapshot) {
+    return snapshot->n_pieces;
+}
+
+const gchar *doc_snapshot_get_piece(DocSnapshot *snapshot, guint index, gsize *length) {
+    DocPiece *piece = &snapshot->pieces[index];
+    *length = piece->bytes;
+    return piece->chunk->data + piece->offset;
+}
+
+gchar *doc_snapshot_flatten(DocSnapshot *snapshot, gsize *length) {
+    gchar *text = g_malloc(snapshot->bytes + 1);
+    gchar *p = text;
+
+    for (guint i = 0; i < snapshot->n_pieces; i++) {
+        DocPiece *piece = &snapshot->pieces[i];
+        memcpy(p, piece->chunk->data + piece->offset, piece->bytes);
+        p += piece->bytes;
+    }
+    *p = '\0';
+    if (length) {
+        *length = snapshot->bytes;
+    }
+    return text;
+}
+
+// Makes the current piece list private to the document before it is edited
+static DocSnapshot *writable_pieces(Document *doc) {
+    DocSnapshot *current = doc->current;
+    if (g_atomic_int_get(&current->ref_count) == 1) {
+        return current;
+    }
+
+    DocSnapshot *copy = snapshot_new(current->n_pieces + 16);
+    memcpy(copy->pieces, current->pieces, current->n_pieces * sizeof(DocPiece));
+    for (guint i = 0; i < current->n_pieces; i++) {
+        g_atomic_int_inc(&copy->pieces[i].chunk->ref_count);
+    }
+    copy->n_pieces = current->n_pieces;
+    copy->bytes = current->bytes;
+    copy->chars = current->chars;
+
+    doc_snapshot_unref(current);
+    doc->current = copy;
+    return copy;
+}
+
+static void insert_pieces(DocSnapshot *pieces, guint index, const DocPiece *items, guint count) {
+    if (pieces->n_pieces + count > pieces->capacity) {
+        pieces->capacity = MAX(pieces->capacity * 2, pieces->n_pieces + count);
+        pieces->pieces = g_renew(DocPiece, pieces->pieces, pieces->capacity);
+    }
+    memmove(&pieces->pieces[index + count], &pieces->pieces[index],
+            (pieces->n_pieces - index) * sizeof(DocPiece));
+    memcpy(&pieces->pieces[index], items, count * sizeof(DocPiece));
+    pieces->n_pieces += count;
+}
+
+// The text between two char offsets as a snapshot of its own; shares the chunks instead of copying them
+DocSnapshot *doc_snapshot_slice(DocSnapshot *snapshot, gsize char_start, gsize char_end) {
+    DocSnapshot *slice = snapshot_new(0);
+    gsize start = 0;
+
+    for (guint i = 0; i < snapshot->n_pieces && start < char_end; i++) {
+        DocPiece piece = snapshot->pieces[i];
+        gsize end = start + piece.chars;
+
+        if (end > char_start) {
+            // Whole pieces are taken as they are; only the two ends need a UTF-8 walk
+            if (start < char_start || end > char_end) {
+                const gchar *base = piece.chunk->data + piece.offset;
+                const gchar *from = g_utf8_offset_to_pointer(base, char_start > start ? char_start - start : 0);
+                piece.chars = MIN(end, char_end) - MAX(start, char_start);
+                piece.offset = from - piece.chunk->data;
+                piece.bytes = g_utf8_offset_to_pointer(from, piece.chars) - from;
+            }
+            g_atomic_int_inc(&piece.chunk->ref_count);
+            insert_pieces(slice, slice->n_pieces, &piece, 1);
+            slice->bytes += piece.bytes;
+            slice->chars += piece.chars;
+        }
+        start = end;
+    }
+    return slice;
+}
+
+// Index of the piece containing char_offset (or n_pieces at the end) and the piece's first char
+static guint find_piece(Document *doc, gsize char_offset, gsize *piece_start) {
+    DocSnapshot *pieces = doc->current;
+    guint index = doc->cached_piece;
+    gsize start = doc->cached_start;
+
+    // Edits applied back to front, like Replace All, walk backwards from the previous one
+    while (index > 0 && start > char_offset) {
+        index--;
+        start -= pieces->pieces[index].chars;
+    }
+    while (index < pieces->n_pieces && start + pieces->pieces[index].chars <= char_offset) {
+        start += pieces->pieces[index].chars;
+        index++;
+    }
+
+    doc->cached_piece = index;
+    doc->cached_start = start;
+    *piece_start = start;
+    return index;
+}
+
+// Ensures a piece boundary at char_offset and returns the index of the piece that starts there
+static guint split_at(Document *doc, gsize char_offset) {
+    gsize start;
+    guint index = find_piece(doc, char_offset, &start);
+    DocSnapshot *pieces = doc->current;
+
+    if (index == pieces->n_pieces || start == char_offset) {
+        return index;
+    }
+
+    DocPiece *piece = &pieces->pieces[index];
+    const gchar *base = piece->chunk->data + piece->offset;
+    gsize head_chars = char_offset - start;
+    gsize head_bytes = g_utf8_offset_to_pointer(base, head_chars) - base;
+
+    DocPiece tail = {
+        piece->chunk,
+        piece->offset + head_bytes,
+        piece->bytes - head_bytes,
+        piece->chars - head_chars
+    };
+    g_atomic_int_inc(&piece->chunk->ref_count);
+    piece->bytes = head_bytes;
+    piece->chars = head_chars;
+    insert_pieces(pieces, index + 1, &tail, 1);
+    return index + 1;
+}
+
+void document_insert(Document *doc, gsize char_offset, const gchar *text, gsize bytes) {
+    if (bytes == 0) {
+        return;
+    }
+    DocSnapshot *pieces = writable_pieces(doc);
+    gsize chars = g_utf8_strlen(text, bytes);
+
+    // Typing at the end of the last insert just grows that piece
+    if (doc->add && doc->add->capacity - doc->add->used >= bytes) {
+        gsize start;
+        guint index = find_piece(doc, char_offset, &start);
+        if (index > 0 && start == char_offset) {
+            DocPiece *prev = &pieces->pieces[index - 1];
+            if (prev->chunk == doc->add && prev->offset + prev->bytes == doc->add->used) {
+                memcpy(doc->add->data + doc->add->used, text, bytes);
+                doc->add->used += bytes;
+                prev->bytes += bytes;
+                prev->chars += chars;
+                pieces->bytes += bytes;
+                pieces->chars += chars;
+                doc->cached_piece = index - 1;
+                doc->cached_start = start - (prev->chars - chars);
+                return;
+            }
+        }
+    }
+
+    if (!doc->add || doc->add->capacity - doc->add->used < bytes) {
+        if (doc->add) {
+            chunk_unref(doc->add);
+        }
+        doc->add = chunk_new(MAX(bytes, DOC_CHUNK_SIZE));
+    }
+
+    DocPiece piece = { doc->add, doc->add->used, bytes, chars };
+    memcpy(doc->add->data + doc->add->used, text, bytes);
+    doc->add->used += bytes;
+    g_atomic_int_inc(&doc->add->ref_count);
+
+    guint index = split_at(doc, char_offset);
+    insert_pieces(pieces, index, &piece, 1);
+    pieces->bytes += bytes;
+    pieces->chars += chars;
+    doc->cached_piece = index;
+    doc->cached_start = char_offset;
+}
+
+void document_delete(Document *doc, gsize char_start, gsize char_end) {
+    if (char_end <= char_start) {
+        return;
+    }
+    DocSnapshot *pieces = writable_pieces(doc);
+    guint first = split_at(doc, char_start);
+    guint last = split_at(doc, char_end);
+
+    for (guint i = first; i < last; i++) {
+        pieces->bytes -= pieces->pieces[i].bytes;
+        pieces->chars -= pieces->pieces[i].chars;
+        chunk_unref(pieces->pieces[i].chunk);
+    }
+    memmove(&pieces->pieces[first], &pieces->pieces[last],
+            (pieces->n_pieces - last) * sizeof(DocPiece));
+    pieces->n_pieces -= last - first;
+    doc->cached_piece = first;
+    doc->cached_start = char_start;
+}
+
+void document_clear(Document *doc) {
+    doc_snapshot_unref(doc->current);
+    doc->current = snapshot_new(0);
+    doc->cached_piece = 0;
+    doc->cached_start = 0;
+}
+
+// O(1): the snapshot shares the piece list until the next edit copies it
+DocSnapshot *document_snapshot(Document *doc) {
+    return doc_snapshot_ref(doc->current);
+}
+
+Document *document_new(void) {
+    Document *doc = g_new0(Document, 1);
+    doc->current = snapshot_new(0);
+    return doc;
+}
+
+void document_free(Document *doc) {
+    doc_snapshot_unref(doc->current);
+    if (doc->add) {
+        chunk_unref(doc->add);
+    }
+    g_free(doc);
+}
+
+static void on_document_insert_text(GtkTextBuffer *buffer, GtkTextIter *location,
+                                    gchar *text, gint len, gpointer data) {
+    document_insert(data, gtk_text_iter_get_offset(location), text, len);
+}
+
+static void on_document_delete_range(GtkTextBuffer *buffer, GtkTextIter *start,
+                                     GtkTextIter *end, gpointer data) {
+    if (gtk_text_iter_is_start(start) && gtk_text_iter_is_end(end)) {
+        document_clear(data);
+        return;
+    }
+    document_delete(data, gtk_text_iter_get_offset(start), gtk_text_iter_get_offset(end));
+}
+
+// Mirrors the buffer into a new document that follows it through the buffer's signals
+Document *document_attach(GtkTextBuffer *buffer) {
+    Document *doc = document_new();
+    GtkTextIter start, end;
+
+    gtk_text_buffer_get_bounds(buffer, &start, &end);
+    if (!gtk_text_iter_equal(&start, &end)) {
+        gchar *text = gtk_text_buffer_get_slice(buffer, &start, &end, TRUE);
+        document_insert(doc, 0, text, strlen(text));
+        g_free(text);
+    }
+
+    g_signal_connect(buffer, "insert-text", G_CALLBACK(on_document_insert_text), doc);
+    g_signal_connect(buffer, "delete-range", G_CALLBACK(on_document_delete_range), doc);
+    return doc;
+}
+
+void doc_cursor_init(DocCursor *cursor, DocSnapshot *snapshot) {
+    cursor->snapshot = snapshot;
+    cursor->piece = 0;
+    cursor->piece_start = 0;
+}
+
+// Compares text against the snapshot at offset; offsets must not decrease between calls
+gboolean doc_cursor_equal(DocCursor *cursor, gsize offset, const gchar *text, gsize length, gboolean match_case) {
+    DocSnapshot *snapshot = cursor->snapshot;
+
+    if (offset + length > snapshot->bytes) {
+        return FALSE;
+    }
+    while (cursor->piece < snapshot->n_pieces &&
+           cursor->piece_start + snapshot->pieces[cursor->piece].bytes <= offset) {
+        cursor->piece_start += snapshot->pieces[cursor->piece].bytes;
+        cursor->piece++;
+    }
+
+    // Matches may straddle piece boundaries, so compare piece by piece
+    guint piece = cursor->piece;
+    gsize piece_start = cursor->piece_start;
+    while (length > 0) {
+        DocPiece *p = &snapshot->pieces[piece];
+        gsize skip = offset - piece_start;
+        gsize n = MIN(length, p->bytes - skip);
+        const gchar *data = p->chunk->data + p->offset + skip;
+        if (match_case ? memcmp(data, text, n) != 0 : g_ascii_strncasecmp(data, text, n) != 0) {
+            return FALSE;
+        }
+        text += n;
+        length -= n;
+        offset += n;
+        piece_start += p->bytes;
+        piece++;
+    }
+    return TRUE;
+}
@@ -0,0 +1,442 @@
+#include "header.h"
+
+// One per notebook tab. The shown tab lives in editor->buffer; the others keep a snapshot or nothing.
+typedef struct {
+    GtkWidget *page;            // Empty notebook page; the text view is shared by all tabs
+    GtkWidget *label;
+    gchar *filename;            // NULL for an untitled tab
+    DocSnapshot *text;          // Contents while hidden; NULL when never loaded or evicted back to disk
+    gboolean is_modified;
+    guint64 change_seq;         // editor->change_seq when the tab was hidden
+    gint64 line;                // Cursor line to come back to
+    gint64 top_line;            // First visible line to come back to
+    guint64 last_used;
+    UndoHistory *undo;
+    Journal *journal;
+} Tab;
+
+static struct {
+    GPtrArray *tabs;            // In notebook order
+    Tab *active;
+    GtkTextMark *top_mark;      // Scroll target when a tab is shown again
+    guint64 clock;
+} documents;
+
+static void close_tab(Tab *tab);
+
+static void free_tab(Tab *tab) {
+    if (tab->text) {
+        doc_snapshot_unref(tab->text);
+    }
+    undo_history_free(tab->undo);
+    journal_free(tab->journal);
+    g_free(tab->filename);
+    g_free(tab);
+}
+
+static Tab *tab_for_page(GtkWidget *page) {
+    for (guint i = 0; i < documents.tabs->len; i++) {
+        Tab *tab = g_ptr_array_index(documents.tabs, i);
+        if (tab->page == page) {
+            return tab;
+        }
+    }
+    return NULL;
+}
+
+// The shown tab's name can change under it (save as), so editor->current_file is authoritative there
+// once its file has been read in; until then the editor holds nothing of it and the tab's name stands
+static const gchar *tab_filename(Tab *tab) {
+    return tab == documents.active && !editor->unloaded ? editor->current_file : tab->filename;
+}
+
+static Tab *find_tab(const gchar *filename) {
+    for (guint i = 0; i < documents.tabs->len; i++) {
+        Tab *tab = g_ptr_array_index(documents.tabs, i);
+        if (g_strcmp0(tab_filename(tab), filename) == 0) {
+            return tab;
+        }
+    }
+    return NULL;
+}
+
+static void update_label(Tab *tab) {
+    const gchar *filename = tab_filename(tab);
+    gboolean modified = tab == documents.active ? editor->is_modified : tab->is_modified;
+    gchar *basename = filename ? g_path_get_basename(filename) : g_strdup("Untitled");
+    gchar *text = g_strdup_printf("%s%s", basename, modified ? " •" : "");
+
+    gtk_label_set_text(GTK_LABEL(tab->label), text);
+    gtk_widget_set_tooltip_text(tab->label, filename);
+    g_free(text);
+    g_free(basename);
+}
+
+// Drops the contents of the least recently used clean tabs until hidden tabs fit the budget
+static void enforce_budget(void) {
+    guint64 used = 0;
+
+    for (guint i = 0; i < documents.tabs->len; i++) {
+        Tab *tab = g_ptr_array_index(documents.tabs, i);
+        if (tab->text) {
+            used += doc_snapshot_get_length(tab->text);
+        }
+    }
+    while (used > editor->document_budget) {
+        Tab *oldest = NULL;
+        for (guint i = 0; i < documents.tabs->len; i++) {
+            Tab *tab = g_ptr_array_index(documents.tabs, i);
+            // Modified and untitled text exists nowhere else, so it always stays; so does text the
+            // tab's undo history refers to
+            if (tab->text && !tab->is_modified && tab->filename && undo_history_is_empty(tab->undo) &&
+                (!oldest || tab->last_used < oldest->last_used)) {
+                oldest = tab;
+            }
+        }
+        if (!oldest) {
+            break;
+        }
+        used -= doc_snapshot_get_length(oldest->text);
+        doc_snapshot_unref(oldest->text);
+        oldest->text = NULL;
+    }
+}
+
+// Cursor and first visible line of the shown document
+static void get_view_position(gint64 *line, gint64 *top_line) {
+    GdkRectangle visible;
+    GtkTextIter iter;
+
+    gtk_text_buffer_get_iter_at_mark(editor->buffer, &iter, gtk_text_buffer_get_insert(editor->buffer));
+    *line = gtk_text_iter_get_line(&iter);
+    gtk_text_view_get_visible_rect(GTK_TEXT_VIEW(editor->text_view), &visible);
+    gtk_text_view_get_line_at_y(GTK_TEXT_VIEW(editor->text_view), &iter, visible.y, NULL);
+    *top_line = gtk_text_iter_get_line(&iter);
+}
+
+static void set_view_position(gint64 line, gint64 top_line) {
+    GtkTextIter iter;
+
+    gtk_text_buffer_get_iter_at_line(editor->buffer, &iter, (gint) line);
+    gtk_text_buffer_place_cursor(editor->buffer, &iter);
+    gtk_text_buffer_get_iter_at_line(editor->buffer, &iter, (gint) top_line);
+    gtk_text_buffer_move_mark(editor->buffer, documents.top_mark, &iter);
+    gtk_text_view_scroll_to_mark(GTK_TEXT_VIEW(editor->text_view), documents.top_mark, 0.0, TRUE, 0.0, 0.0);
+}
+
+// Moves the shown document out of the editor into its tab
+static void stash_active(void) {
+    Tab *tab = documents.active;
+
+    if (!tab) {
+        return;
+    }
+    if (!editor->unloaded) {
+        g_free(tab->filename);
+        tab->filename = g_strdup(editor->current_file);
+    }
+    tab->last_used = ++documents.clock;
+
+    // A tab hidden while loading or in the viewer keeps the position it was opened with
+    if (viewer_is_active()) {
+        viewer_close();
+        tab->is_modified = FALSE;
+    } else if (editor->loading) {
+        // Partially loaded; read it again from the start next time
+        cancel_file_load();
+        tab->is_modified = FALSE;
+    } else {
+        get_view_position(&tab->line, &tab->top_line);
+        tab->text = document_snapshot(editor->document);
+        tab->is_modified = editor->is_modified;
+        tab->change_seq = editor->change_seq;
+    }
+    documents.active = NULL;
+    update_label(tab);
+}
+
+static void show_tab(Tab *tab) {
+    documents.active = tab;
+    tab->last_used = ++documents.clock;
+    undo_set_history(tab->undo);
+
+    // Replacing the buffer is not an edit
+    journal_set_active(NULL);
+
+    if (tab->text) {
+        gsize length;
+        gchar *text = doc_snapshot_flatten(tab->text, &length);
+        cancel_file_load();
+        viewer_close();
+        g_free(editor->current_file);
+        editor->current_file = g_strdup(tab->filename);
+        highlight_set_file(tab->filename);
+        gtk_text_buffer_set_text(editor->buffer, text, length);
+        g_free(text);
+        doc_snapshot_unref(tab->text);
+        tab->text = NULL;
+        editor->is_modified = tab->is_modified;
+        editor->unloaded = FALSE;
+        gtk_text_view_set_editable(GTK_TEXT_VIEW(editor->text_view), TRUE);
+        set_view_position(tab->line, tab->top_line);
+    } else if (tab->filename) {
+        // Never loaded or evicted: read it from disk now. The editor only takes the name once the
+        // load succeeds, so a cancelled or failed load leaves nothing that could be saved over it.
+        g_clear_pointer(&editor->current_file, g_free);
+        editor->unloaded = TRUE;
+        if (!open_file(tab->filename)) {
+            // Not even started (the viewer could not map it); drop the previous tab's text
+            cancel_file_load();
+            viewer_close();
+            gtk_text_buffer_set_text(editor->buffer, "", 0);
+            gtk_text_view_set_editable(GTK_TEXT_VIEW(editor->text_view), FALSE);
+        } else if (tab->line > 0) {
+            if (editor->loading) {
+                editor->pending_goto_line = tab->line;
+            } else {
+                goto_line(tab->line);
+            }
+        }
+        editor->is_modified = FALSE;
+    } else {
+        cancel_file_load();
+        viewer_close();
+        highlight_set_file(NULL);
+        gtk_text_buffer_set_text(editor->buffer, "", 0);
+        g_free(editor->current_file);
+        editor->current_file = NULL;
+        editor->is_modified = FALSE;
+        editor->unloaded = FALSE;
+        gtk_text_view_set_editable(GTK_TEXT_VIEW(editor->text_view), TRUE);
+    }
+    journal_set_active(tab->journal);
+    enforce_budget();
+    schedule_refresh(REFRESH_ALL);
+    session_changed();
+}
+
+static void on_switch_page(GtkNotebook *notebook, GtkWidget *page, guint page_num, gpointer data) {
+    Tab *tab = tab_for_page(page);
+
+    if (!tab || tab == documents.active) {
+        return;
+    }
+    stash_active();
+    show_tab(tab);
+}
+
+static void on_tab_close_clicked(GtkButton *button, gpointer data) {
+    close_tab(data);
+}
+
+// Adds a tab without reading the file; it is loaded when first shown
+static Tab *add_tab(const gchar *filename) {
+    Tab *tab = g_new0(Tab, 1);
+    tab->filename = g_strdup(filename);
+    tab->undo = undo_history_new();
+    tab->journal = journal_new();
+    tab->page = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
+    gtk_widget_show(tab->page);
+
+    GtkWidget *box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 4);
+    tab->label = gtk_label_new(NULL);
+    gtk_box_pack_start(GTK_BOX(box), tab->label, FALSE, FALSE, 0);
+    GtkWidget *close_button = gtk_button_new_from_icon_name("window-close-symbolic", GTK_ICON_SIZE_MENU);
+    gtk_button_set_relief(GTK_BUTTON(close_button), GTK_RELIEF_NONE);
+    gtk_widget_set_tooltip_text(close_button, "Close (Ctrl+W)");
+    g_signal_connect(close_button, "clicked", G_CALLBACK(on_tab_close_clicked), tab);
+    gtk_box_pack_start(GTK_BOX(box), close_button, FALSE, FALSE, 0);
+    gtk_widget_show_all(box);
+
+    g_ptr_array_add(documents.tabs, tab);
+    gtk_notebook_append_page(GTK_NOTEBOOK(editor->notebook), tab->page, box);
+    update_label(tab);
+    session_changed();
+    return tab;
+}
+
+static void activate_tab(Tab *tab) {
+    gtk_notebook_set_current_page(GTK_NOTEBOOK(editor->notebook),
+                                  gtk_notebook_page_num(GTK_NOTEBOOK(editor->notebook), tab->page));
+}
+
+static void close_tab(Tab *tab) {
+    gboolean modified = tab == documents.active ? editor->is_modified : tab->is_modified;
+
+    if (modified) {
+        gchar *basename = tab_filename(tab) ? g_path_get_basename(tab_filename(tab)) : g_strdup("Untitled");
+        GtkWidget *dialog = gtk_message_dialog_new(GTK_WINDOW(editor->window),
+                                           GTK_DIALOG_MODAL,
+                                           GTK_MESSAGE_QUESTION,
+                                           GTK_BUTTONS_NONE,
+                                           "Close %s without saving?", basename);
+        gtk_dialog_add_buttons(GTK_DIALOG(dialog),
+                               "_Cancel", GTK_RESPONSE_CANCEL,
+                               "Close _Without Saving", GTK_RESPONSE_CLOSE,
+                               NULL);
+        gint response = gtk_dialog_run(GTK_DIALOG(dialog));
+        gtk_widget_destroy(dialog);
+        g_free(basename);
+        if (response != GTK_RESPONSE_CLOSE) {
+            return;
+        }
+    }
+
+    // The notebook always keeps one tab; removing the shown one switches to a neighbour
+    if (documents.tabs->len == 1) {
+        add_tab(NULL);
+    }
+    if (tab == documents.active) {
+        documents.active = NULL;
+    }
+    g_ptr_array_remove(documents.tabs, tab);
+    gtk_notebook_remove_page(GTK_NOTEBOOK(editor->notebook),
+                             gtk_notebook_page_num(GTK_NOTEBOOK(editor->notebook), tab->page));
+    free_tab(tab);
+    session_changed();
+}
+
+// Shows filename, reusing its tab or an empty untitled one if there is one
+void documents_open(const gchar *filename) {
+    Tab *tab = find_tab(filename);
+    Tab *active = documents.active;
+
+    if (tab) {
+        activate_tab(tab);
+        return;
+    }
+    if (active && !active->filename && !editor->current_file && !editor->is_modified && !editor->loading &&
+        gtk_text_buffer_get_char_count(editor->buffer) == 0) {
+        active->filename = g_strdup(filename);
+        open_file(filename);
+        update_label(active);
+        return;
+    }
+    activate_tab(add_tab(filename));
+}
+
+// Adds a tab for filename that is only read once the user switches to it
+void documents_add(const gchar *filename, gint64 line, gint64 top_line) {
+    if (!find_tab(filename)) {
+        Tab *tab = add_tab(filename);
+        tab->line = line;
+        tab->top_line = top_line;
+    }
+}
+
+// Closes hidden untitled tabs that were never typed into, like the one the editor starts with
+void documents_remove_blank(void) {
+    for (guint i = documents.tabs->len; i-- > 0;) {
+        Tab *tab = g_ptr_array_index(documents.tabs, i);
+        if (tab != documents.active && !tab->filename && !tab->is_modified &&
+            (!tab->text || doc_snapshot_get_length(tab->text) == 0)) {
+            close_tab(tab);
+        }
+    }
+}
+
+guint documents_get_count(void) {
+    return documents.tabs->len;
+}
+
+gint documents_get_active(void) {
+    for (guint i = 0; i < documents.tabs->len; i++) {
+        if (g_ptr_array_index(documents.tabs, i) == documents.active) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// File name (NULL if untitled) and position of the tab at index
+const gchar *documents_get_tab(guint index, gint64 *line, gint64 *top_line) {
+    Tab *tab = g_ptr_array_index(documents.tabs, index);
+
+    if (tab == documents.active && !editor->unloaded && !viewer_is_active()) {
+        get_view_position(line, top_line);
+    } else {
+        *line = tab->line;
+        *top_line = tab->top_line;
+    }
+    return tab_filename(tab);
+}
+
+void documents_new(void) {
+    activate_tab(add_tab(NULL));
+}
+
+void documents_close_current(void) {
+    if (documents.active) {
+        close_tab(documents.active);
+    }
+}
+
+// Name of the shown tab, even while its file is still being read in
+const gchar *documents_get_active_filename(void) {
+    return documents.active ? tab_filename(documents.active) : editor->current_file;
+}
+
+void documents_update_label(void) {
+    if (documents.active) {
+        update_label(documents.active);
+    }
+}
+
+// A background save of a tab that was hidden while the write was in flight
+void documents_saved(const gchar *filename, guint64 change_seq) {
+    Tab *tab = find_tab(filename);
+
+    if (tab && tab != documents.active && tab->change_seq == change_seq) {
+        tab->is_modified = FALSE;
+        journal_discard(tab->journal);
+        update_label(tab);
+    }
+}
+
+// Unsaved text replayed from a journal left by a crash; the tab takes the journal over
+void documents_recover(const gchar *filename, DocSnapshot *text, Journal *journal) {
+    Tab *tab = filename ? find_tab(filename) : NULL;
+
+    if (!tab) {
+        tab = add_tab(filename);
+    }
+    journal_free(tab->journal);
+    tab->journal = journal;
+    g_free(tab->filename);
+    tab->filename = g_strdup(filename);
+    if (tab->text) {
+        doc_snapshot_unref(tab->text);
+    }
+    tab->text = text;
+    tab->is_modified = TRUE;
+    tab->change_seq = 0;
+
+    // Shown: put the recovered text in the buffer, dropping whatever was loaded from disk
+    if (tab == documents.active) {
+        show_tab(tab);
+    } else {
+        update_label(tab);
+    }
+}
+
+// Hidden tabs with unsaved changes; the shown one is covered by editor->is_modified
+guint documents_unsaved_count(void) {
+    guint count = 0;
+
+    for (guint i = 0; i < documents.tabs->len; i++) {
+        Tab *tab = g_ptr_array_index(documents.tabs, i);
+        count += tab != documents.active && tab->is_modified;
+    }
+    return count;
+}
+
+void setup_documents(void) {
+    documents.tabs = g_ptr_array_new();
+    documents.top_mark = gtk_text_buffer_create_mark(editor->buffer, NULL, NULL, TRUE);
+
+    // The first tab takes over the empty buffer the editor starts with
+    documents.active = add_tab(NULL);
+    undo_set_history(documents.active->undo);
+    journal_set_active(documents.active->journal);
+    g_signal_connect(editor->notebook, "switch-page", G_CALLBACK(on_switch_page), NULL);
+}
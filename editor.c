@@ -1,16 +1,133 @@
 #include "header.h"
 
+#define GUTTER_PADDING 8
+#define ZOOM_MIN 6.0
+#define ZOOM_MAX 48.0
+
+// Font size currently loaded into the text view's own provider
+static GtkCssProvider *font_provider = NULL;
+static gdouble applied_zoom = 0;
+
+static gint count_digits(gint64 n) {
+    gint digits = 1;
+    while (n >= 10) {
+        n /= 10;
+        digits++;
+    }
+    return digits;
+}
+
+static void resize_gutter(void) {
+    // Width follows the text view font, so zoom changes are picked up here
+    PangoLayout *layout = gtk_widget_create_pango_layout(editor->text_view, "9");
+    gint digit_width;
+    pango_layout_get_pixel_size(layout, &digit_width, NULL);
+    g_object_unref(layout);
+
+    gtk_text_view_set_border_window_size(GTK_TEXT_VIEW(editor->text_view), GTK_TEXT_WINDOW_LEFT,
+                                         digit_width * editor->gutter_digits + 2 * GUTTER_PADDING);
+}
+
+static void on_gutter_style_updated(GtkWidget *widget, gpointer data) {
+    resize_gutter();
+}
+
+// Paints line numbers for the visible lines only, so the cost does not depend on file length
+static gboolean on_gutter_draw(GtkWidget *widget, cairo_t *cr, gpointer data) {
+    GtkTextView *view = GTK_TEXT_VIEW(widget);
+    GdkWindow *window = gtk_text_view_get_window(view, GTK_TEXT_WINDOW_LEFT);
+    if (!window || !gtk_cairo_should_draw_window(cr, window)) {
+        return FALSE;
+    }
+    gint64 perf_start = perf_begin();
+
+    cairo_save(cr);
+    gtk_cairo_transform_to_window(cr, widget, window);
+    gint width = gdk_window_get_width(window);
+    gint height = gdk_window_get_height(window);
+
+    GtkStyleContext *context = gtk_widget_get_style_context(widget);
+    gtk_style_context_save(context);
+    gtk_style_context_add_class(context, "line-numbers");
+    gtk_render_background(context, cr, 0, 0, width, height);
+    gtk_render_frame(context, cr, 0, 0, width, height);
+
+    GdkRectangle visible;
+    GtkTextIter iter;
+    gint line_top;
+    gtk_text_view_get_visible_rect(view, &visible);
+    gtk_text_view_get_line_at_y(view, &iter, visible.y, &line_top);
+
+    GtkTextBuffer *buffer = gtk_text_view_get_buffer(view);
+    gint total_lines = gtk_text_buffer_get_line_count(buffer);
+    PangoLayout *layout = gtk_widget_create_pango_layout(widget, NULL);
+    gchar number[16];
+    gint first_line = gtk_text_iter_get_line(&iter);
+
+    for (gint line = first_line; line < total_lines; line++) {
+        gint y, line_height, window_y, text_width;
+        gtk_text_buffer_get_iter_at_line(buffer, &iter, line);
+        gtk_text_view_get_line_yrange(view, &iter, &y, &line_height);
+        if (y > visible.y + visible.height) {
+            break;
+        }
+        gtk_text_view_buffer_to_window_coords(view, GTK_TEXT_WINDOW_LEFT, 0, y, NULL, &window_y);
+
+        g_snprintf(number, sizeof(number), "%" G_GINT64_FORMAT, editor->gutter_line_offset + line + 1);
+        pango_layout_set_text(layout, number, -1);
+        pango_layout_get_pixel_size(layout, &text_width, NULL);
+        gtk_render_layout(context, cr, width - text_width - GUTTER_PADDING, window_y, layout);
+    }
+
+    g_object_unref(layout);
+    gtk_style_context_restore(context);
+    cairo_restore(cr);
+    perf_end(PERF_GUTTER_DRAW, perf_start);
+    return FALSE;
+}
+
+// Only the text view (and so the gutter, through style-updated) restyles; the rest of the window is untouched
+void update_font(void) {
+    gchar size[G_ASCII_DTOSTR_BUF_SIZE];
+
+    if (editor->zoom_level == applied_zoom) {
+        return;
+    }
+    applied_zoom = editor->zoom_level;
+    g_ascii_formatd(size, sizeof(size), "%.1f", editor->zoom_level);
+    gchar *css = g_strdup_printf("textview { font-size: %spt; }", size);
+    gtk_css_provider_load_from_data(font_provider, css, -1, NULL);
+    g_free(css);
+}
+
+// Coalesced through the refresh scheduler, so a burst of scroll events costs one restyle per frame
+void set_zoom(gdouble size) {
+    editor->zoom_level = CLAMP(size, ZOOM_MIN, ZOOM_MAX);
+    schedule_refresh(REFRESH_FONT);
+}
+
+static gboolean on_text_view_scroll(GtkWidget *widget, GdkEventScroll *event, gpointer data) {
+    gdouble dx, dy;
+
+    if (!(event->state & GDK_CONTROL_MASK)) {
+        return FALSE;
+    }
+    if (event->direction == GDK_SCROLL_UP) {
+        dy = -1;
+    } else if (event->direction == GDK_SCROLL_DOWN) {
+        dy = 1;
+    } else if (!gdk_event_get_scroll_deltas((GdkEvent *) event, &dx, &dy)) {
+        return TRUE;
+    }
+    // One point per wheel notch; touchpads scale smoothly with their fractional deltas
+    set_zoom(editor->zoom_level - dy);
+    return TRUE;
+}
+
 void setup_editor(void) {
     // Create editor area
     GtkWidget *editor_hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
 
-    // Line numbers
-    editor->line_numbers = gtk_label_new("1\n");
-    gtk_label_set_xalign(GTK_LABEL(editor->line_numbers), 1.0);
-    gtk_label_set_yalign(GTK_LABEL(editor->line_numbers), 0.0);
-    gtk_style_context_add_class(gtk_widget_get_style_context(editor->line_numbers), "line-numbers");
-    gtk_box_pack_start(GTK_BOX(editor_hbox), editor->line_numbers, FALSE, FALSE, 0);
-
     // Text view with scrolling
     GtkWidget *scrolled = gtk_scrolled_window_new(NULL, NULL);
     gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled),
@@ -18,18 +135,58 @@ void setup_editor(void) {
 
     editor->text_view = gtk_text_view_new();
     editor->buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(editor->text_view));
-    
+    stats_attach(editor->buffer, &editor->stats);
+    undo_attach(editor->buffer);
+    editor->document = document_attach(editor->buffer);
+
     gtk_text_view_set_wrap_mode(GTK_TEXT_VIEW(editor->text_view), GTK_WRAP_NONE);
     gtk_text_view_set_monospace(GTK_TEXT_VIEW(editor->text_view), TRUE);
 
+    // Zoom is a provider on this widget alone; above the theme so a theme file cannot override it
+    font_provider = gtk_css_provider_new();
+    gtk_style_context_add_provider(gtk_widget_get_style_context(editor->text_view),
+                                   GTK_STYLE_PROVIDER(font_provider), GTK_STYLE_PROVIDER_PRIORITY_APPLICATION + 1);
+    update_font();
+    gtk_widget_add_events(editor->text_view, GDK_SCROLL_MASK | GDK_SMOOTH_SCROLL_MASK);
+    g_signal_connect(editor->text_view, "scroll-event", G_CALLBACK(on_text_view_scroll), NULL);
+
+    // Line numbers live in the text view's left border window
+    editor->gutter_digits = 2;
+    resize_gutter();
+    g_signal_connect(editor->text_view, "draw", G_CALLBACK(on_gutter_draw), NULL);
+    g_signal_connect(editor->text_view, "style-updated", G_CALLBACK(on_gutter_style_updated), NULL);
+
     gtk_container_add(GTK_CONTAINER(scrolled), editor->text_view);
     gtk_box_pack_start(GTK_BOX(editor_hbox), scrolled, TRUE, TRUE, 0);
 
+    // Whole-file scrollbar, only shown by the large file viewer
+    editor->viewer_scrollbar = gtk_scrollbar_new(GTK_ORIENTATION_VERTICAL, NULL);
+    gtk_widget_set_no_show_all(editor->viewer_scrollbar, TRUE);
+    gtk_box_pack_start(GTK_BOX(editor_hbox), editor->viewer_scrollbar, FALSE, FALSE, 0);
+
+    // Tabs sit above the text view; their pages are empty since every tab shares the view
+    GtkWidget *editor_vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
+    editor->notebook = gtk_notebook_new();
+    gtk_notebook_set_scrollable(GTK_NOTEBOOK(editor->notebook), TRUE);
+    gtk_notebook_set_show_border(GTK_NOTEBOOK(editor->notebook), FALSE);
+    gtk_box_pack_start(GTK_BOX(editor_vbox), editor->notebook, FALSE, FALSE, 0);
+    editor->overlay = gtk_overlay_new();
+    gtk_container_add(GTK_CONTAINER(editor->overlay), editor_hbox);
+    gtk_box_pack_start(GTK_BOX(editor_vbox), editor->overlay, TRUE, TRUE, 0);
+
     // Add editor to paned widget
-    gtk_paned_pack1(GTK_PANED(editor->paned), editor_hbox, TRUE, FALSE);
+    gtk_paned_pack1(GTK_PANED(editor->paned), editor_vbox, TRUE, FALSE);
 }
 
 void update_status_bar(void) {
+    if (viewer_is_active()) {
+        gchar *msg = viewer_status_text();
+        gtk_statusbar_pop(GTK_STATUSBAR(editor->status_bar), 0);
+        gtk_statusbar_push(GTK_STATUSBAR(editor->status_bar), 0, msg);
+        g_free(msg);
+        return;
+    }
+
     GtkTextIter iter;
     GtkTextMark *mark = gtk_text_buffer_get_insert(editor->buffer);
     gtk_text_buffer_get_iter_at_mark(editor->buffer, &iter, mark);
@@ -37,37 +194,37 @@ void update_status_bar(void) {
     int line = gtk_text_iter_get_line(&iter) + 1;
     int col = gtk_text_iter_get_line_offset(&iter) + 1;
 
-    GtkTextIter end;
-    gtk_text_buffer_get_end_iter(editor->buffer, &end);
-    int total_lines = gtk_text_iter_get_line(&end) + 1;
-    gint char_count = gtk_text_buffer_get_char_count(editor->buffer);
-
-    gchar *msg = g_strdup_printf("Line %d/%d, Column %d • %d characters",
-                                 line, total_lines, col, char_count);
+    gchar *msg = g_strdup_printf("Line %d/%" G_GINT64_FORMAT ", Column %d • %" G_GINT64_FORMAT
+                                 " characters • %" G_GINT64_FORMAT " words%s",
+                                 line, editor->stats.lines, col, editor->stats.chars, editor->stats.words,
+                                 save_in_progress() ? " • Saving…" : "");
     gtk_statusbar_pop(GTK_STATUSBAR(editor->status_bar), 0);
     gtk_statusbar_push(GTK_STATUSBAR(editor->status_bar), 0, msg);
     g_free(msg);
 }
 
 void update_line_numbers(void) {
-    GtkTextIter end;
-    gtk_text_buffer_get_end_iter(editor->buffer, &end);
-    int total_lines = gtk_text_iter_get_line(&end) + 1;
-
-    GString *line_str = g_string_new("");
-    for (int i = 1; i <= total_lines; i++) {
-        g_string_append_printf(line_str, "%d\n", i);
+    gint64 total_lines = viewer_is_active() ? viewer_line_count() : editor->stats.lines;
+    gint digits = MAX(count_digits(total_lines), 2);
+    if (digits != editor->gutter_digits) {
+        editor->gutter_digits = digits;
+        resize_gutter();
     }
 
-    gtk_label_set_text(GTK_LABEL(editor->line_numbers), line_str->str);
-    g_string_free(line_str, TRUE);
+    // Edits can shift every visible line, so repaint the (visible) gutter
+    GdkWindow *window = gtk_text_view_get_window(GTK_TEXT_VIEW(editor->text_view), GTK_TEXT_WINDOW_LEFT);
+    if (window) {
+        gdk_window_invalidate_rect(window, NULL, FALSE);
+    }
 }
 
 void update_window_title(void) {
+    const gchar *filename = documents_get_active_filename();
     gchar *title;
-    if (editor->current_file) {
-        gchar *basename = g_path_get_basename(editor->current_file);
-        title = g_strdup_printf("%s%s", basename, editor->is_modified ? " •" : "");
+    if (filename) {
+        gchar *basename = g_path_get_basename(filename);
+        title = g_strdup_printf("%s%s%s", basename, editor->is_modified ? " •" : "",
+                                viewer_is_active() ? " (read-only)" : "");
         g_free(basename);
     } else {
         title = g_strdup_printf("Untitled%s", editor->is_modified ? " •" : "");
@@ -0,0 +1,436 @@
+#include "header.h"
+#include <glib/gstdio.h>
+
+#define FIND_BINARY_PROBE 8000                 // Leading bytes checked for NUL to detect binary files
+#define FIND_MAX_RESULTS 20000                 // The walk stops adding results beyond this
+#define FIND_MAX_LINE_TEXT 240                 // Bytes of the matching line shown in the list
+#define FIND_DRAIN_INTERVAL 50                 // ms between moves from the result queue into the list
+#define FIND_DRAIN_BATCH 500                   // Rows added per drain so the UI stays responsive
+
+enum {
+    FIND_COLUMN_LOCATION,
+    FIND_COLUMN_TEXT,
+    FIND_COLUMN_PATH,
+    FIND_COLUMN_LINE,
+    FIND_N_COLUMNS
+};
+
+typedef struct {
+    gchar *path;
+    gint64 line;
+    gchar *text;
+} FindResult;
+
+typedef struct {
+    gchar *path;
+    gboolean is_dir;
+} FindWork;
+
+typedef struct {
+    gchar *root;
+    gchar *query;
+    gboolean match_case;
+    GPtrArray *ignore;          // GPatternSpec matched against entry names
+    GThreadPool *pool;
+    GAsyncQueue *results;       // FindResult, drained on the main thread
+    GCancellable *cancellable;
+    gint pending;               // Work items queued or running
+    gint n_results;
+    gint n_files;               // Text files searched
+    gboolean indexed;           // Candidates came from the trigram index
+    gboolean finished;          // Main thread only
+} FindJob;
+
+static struct {
+    GtkWidget *panel;
+    GtkWidget *entry;
+    GtkWidget *label;
+    GtkWidget *use_index;
+    GtkListStore *store;
+    FindJob *job;               // Job whose results are listed
+    guint drain_source;
+} find;
+
+static const gchar *default_ignores[] = { ".git", ".hg", ".svn", "node_modules", "__pycache__" };
+
+static void free_result(gpointer data) {
+    FindResult *result = data;
+    g_free(result->path);
+    g_free(result->text);
+    g_free(result);
+}
+
+static void free_job(FindJob *job) {
+    g_free(job->root);
+    g_free(job->query);
+    g_ptr_array_unref(job->ignore);
+    g_async_queue_unref(job->results);
+    g_object_unref(job->cancellable);
+    g_free(job);
+}
+
+// Default names plus the simple name patterns of the root .gitignore
+GPtrArray *find_files_load_ignores(const gchar *root) {
+    GPtrArray *ignore = g_ptr_array_new_with_free_func((GDestroyNotify) g_pattern_spec_free);
+    gchar *path = g_build_filename(root, ".gitignore", NULL);
+    gchar *contents = NULL;
+
+    for (guint i = 0; i < G_N_ELEMENTS(default_ignores); i++) {
+        g_ptr_array_add(ignore, g_pattern_spec_new(default_ignores[i]));
+    }
+    if (g_file_get_contents(path, &contents, NULL, NULL)) {
+        gchar **lines = g_strsplit(contents, "\n", -1);
+        for (gchar **line = lines; *line; line++) {
+            gchar *pattern = g_strstrip(*line);
+            if (*pattern == '/') {
+                pattern++;
+            }
+            gsize len = strlen(pattern);
+            if (len > 0 && pattern[len - 1] == '/') {
+                pattern[--len] = '\0';
+            }
+            // Negations and path patterns are not supported
+            if (len == 0 || *pattern == '#' || *pattern == '!' || strchr(pattern, '/')) {
+                continue;
+            }
+            g_ptr_array_add(ignore, g_pattern_spec_new(pattern));
+        }
+        g_strfreev(lines);
+        g_free(contents);
+    }
+    g_free(path);
+    return ignore;
+}
+
+gboolean find_files_is_ignored(GPtrArray *ignore, const gchar *name) {
+    for (guint i = 0; i < ignore->len; i++) {
+        if (g_pattern_spec_match_string(g_ptr_array_index(ignore, i), name)) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+gboolean find_files_is_binary(const gchar *contents, gsize length) {
+    return memchr(contents, '\0', MIN(length, FIND_BINARY_PROBE)) != NULL;
+}
+
+static void push_work(FindJob *job, gchar *path, gboolean is_dir) {
+    FindWork *work = g_new(FindWork, 1);
+    work->path = path;
+    work->is_dir = is_dir;
+    g_atomic_int_inc(&job->pending);
+    g_thread_pool_push(job->pool, work, NULL);
+}
+
+static void scan_directory(FindJob *job, const gchar *path) {
+    GDir *dir = g_dir_open(path, 0, NULL);
+    const gchar *name;
+
+    if (!dir) {
+        return;
+    }
+    while ((name = g_dir_read_name(dir)) != NULL) {
+        if (find_files_is_ignored(job->ignore, name)) {
+            continue;
+        }
+        gchar *child = g_build_filename(path, name, NULL);
+        GStatBuf st;
+
+        // lstat, so symlinked directories cannot send the walk in circles
+        if (g_lstat(child, &st) != 0) {
+            g_free(child);
+        } else if (S_ISDIR(st.st_mode)) {
+            push_work(job, child, TRUE);
+        } else if (S_ISREG(st.st_mode) && st.st_size > 0 && st.st_size <= FIND_MAX_FILE_SIZE) {
+            push_work(job, child, FALSE);
+        } else {
+            g_free(child);
+        }
+    }
+    g_dir_close(dir);
+}
+
+static gint64 count_lines(const gchar *p, const gchar *end) {
+    gint64 lines = 0;
+    while ((p = memchr(p, '\n', end - p)) != NULL) {
+        lines++;
+        p++;
+    }
+    return lines;
+}
+
+// Reports each line containing the query once
+static void search_file(FindJob *job, const gchar *path) {
+    gchar *contents;
+    gsize length;
+
+    if (!g_file_get_contents(path, &contents, &length, NULL)) {
+        return;
+    }
+    if (find_files_is_binary(contents, length)) {
+        g_free(contents);
+        return;
+    }
+    g_atomic_int_inc(&job->n_files);
+
+    gsize query_len = strlen(job->query);
+    const gchar *end = contents + length;
+    const gchar *counted = contents;
+    const gchar *p = contents;
+    gint64 line = 0;
+
+    while ((p = search_find(p, end - p, job->query, query_len, job->match_case)) != NULL) {
+        line += count_lines(counted, p);
+
+        const gchar *line_start = p;
+        while (line_start > contents && line_start[-1] != '\n') {
+            line_start--;
+        }
+        const gchar *line_end = memchr(p, '\n', end - p);
+        if (!line_end) {
+            line_end = end;
+        }
+
+        FindResult *result = g_new(FindResult, 1);
+        result->path = g_strdup(path);
+        result->line = line;
+        result->text = g_utf8_make_valid(line_start, MIN(line_end - line_start, FIND_MAX_LINE_TEXT));
+        g_strstrip(result->text);
+        g_async_queue_push(job->results, result);
+
+        if (g_atomic_int_add(&job->n_results, 1) + 1 >= FIND_MAX_RESULTS || line_end == end) {
+            break;
+        }
+        counted = line_end;
+        p = line_end;
+    }
+    g_free(contents);
+}
+
+static gboolean on_job_finished(gpointer data) {
+    FindJob *job = data;
+
+    g_thread_pool_free(job->pool, FALSE, TRUE);
+    job->pool = NULL;
+    job->finished = TRUE;
+    if (job != find.job) {
+        free_job(job);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+static void find_worker(gpointer data, gpointer user_data) {
+    FindWork *work = data;
+    FindJob *job = user_data;
+
+    if (!g_cancellable_is_cancelled(job->cancellable) && g_atomic_int_get(&job->n_results) < FIND_MAX_RESULTS) {
+        if (work->is_dir) {
+            scan_directory(job, work->path);
+        } else {
+            search_file(job, work->path);
+        }
+    }
+    g_free(work->path);
+    g_free(work);
+
+    // Children are queued before their parent retires, so zero means the walk is complete
+    if (g_atomic_int_dec_and_test(&job->pending)) {
+        g_idle_add(on_job_finished, job);
+    }
+}
+
+static void update_label(FindJob *job) {
+    gint results = g_atomic_int_get(&job->n_results);
+    gint files = g_atomic_int_get(&job->n_files);
+    gchar *text;
+
+    if (!job->finished) {
+        text = g_strdup_printf("Searching… %d matches in %d files", results, files);
+    } else if (results >= FIND_MAX_RESULTS) {
+        text = g_strdup_printf("First %d matches shown", FIND_MAX_RESULTS);
+    } else {
+        text = g_strdup_printf("%d matches in %d files", results, files);
+    }
+    if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(find.use_index))) {
+        gchar *status = g_strdup_printf("%s (%s)", text, job->indexed ? "index" : trigram_index_status(job->root));
+        g_free(text);
+        text = status;
+    }
+    gtk_label_set_text(GTK_LABEL(find.label), text);
+    g_free(text);
+}
+
+static gboolean on_drain_timeout(gpointer data) {
+    FindJob *job = find.job;
+    gsize root_len = strlen(job->root);
+    FindResult *result;
+
+    for (guint i = 0; i < FIND_DRAIN_BATCH && (result = g_async_queue_try_pop(job->results)) != NULL; i++) {
+        const gchar *relative = result->path;
+        if (g_str_has_prefix(relative, job->root) && G_IS_DIR_SEPARATOR(relative[root_len])) {
+            relative += root_len + 1;
+        }
+        gchar *location = g_strdup_printf("%s:%" G_GINT64_FORMAT, relative, result->line + 1);
+        gtk_list_store_insert_with_values(find.store, NULL, -1,
+                                          FIND_COLUMN_LOCATION, location,
+                                          FIND_COLUMN_TEXT, result->text,
+                                          FIND_COLUMN_PATH, result->path,
+                                          FIND_COLUMN_LINE, result->line,
+                                          -1);
+        g_free(location);
+        free_result(result);
+    }
+    update_label(job);
+
+    if (job->finished && g_async_queue_length(job->results) == 0) {
+        find.drain_source = 0;
+        return G_SOURCE_REMOVE;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static void cancel_job(void) {
+    if (find.drain_source) {
+        g_source_remove(find.drain_source);
+        find.drain_source = 0;
+    }
+    if (!find.job) {
+        return;
+    }
+    g_cancellable_cancel(find.job->cancellable);
+    if (find.job->finished) {
+        free_job(find.job);
+    }
+    // A running job frees itself from on_job_finished once it is no longer current
+    find.job = NULL;
+}
+
+// Rooted at the current file's directory, falling back to the working directory
+static gchar *search_root(void) {
+    if (editor->current_file) {
+        return g_path_get_dirname(editor->current_file);
+    }
+    return g_get_current_dir();
+}
+
+static void start_find(const gchar *query) {
+    cancel_job();
+    gtk_list_store_clear(find.store);
+    if (!*query) {
+        gtk_label_set_text(GTK_LABEL(find.label), "");
+        return;
+    }
+
+    FindJob *job = g_new0(FindJob, 1);
+    job->root = search_root();
+    job->query = g_strdup(query);
+    job->match_case = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(editor->match_case_button));
+    job->ignore = find_files_load_ignores(job->root);
+    job->results = g_async_queue_new_full(free_result);
+    job->cancellable = g_cancellable_new();
+    job->pool = g_thread_pool_new(find_worker, job, g_get_num_processors(), FALSE, NULL);
+    find.job = job;
+
+    // The index narrows the files to verify; without an answer from it the whole tree is walked
+    GPtrArray *candidates = NULL;
+    if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(find.use_index))) {
+        trigram_index_request(job->root);
+        candidates = trigram_index_candidates(job->root, query);
+    }
+    // A guard item held while queueing, so workers that finish early cannot retire the job
+    g_atomic_int_inc(&job->pending);
+    if (!candidates) {
+        push_work(job, g_strdup(job->root), TRUE);
+    } else {
+        job->indexed = TRUE;
+        for (guint i = 0; i < candidates->len; i++) {
+            push_work(job, g_strdup(g_ptr_array_index(candidates, i)), FALSE);
+        }
+        g_ptr_array_unref(candidates);
+    }
+    if (g_atomic_int_dec_and_test(&job->pending)) {
+        g_idle_add(on_job_finished, job);
+    }
+    find.drain_source = g_timeout_add(FIND_DRAIN_INTERVAL, on_drain_timeout, NULL);
+    update_label(job);
+}
+
+static void on_find_entry_activate(GtkEntry *entry, gpointer data) {
+    start_find(gtk_entry_get_text(entry));
+}
+
+static void on_use_index_toggled(GtkToggleButton *button, gpointer data) {
+    if (gtk_toggle_button_get_active(button)) {
+        gchar *root = search_root();
+        trigram_index_request(root);
+        g_free(root);
+    }
+}
+
+static void on_result_activated(GtkTreeView *view, GtkTreePath *path, GtkTreeViewColumn *column, gpointer data) {
+    GtkTreeModel *model = gtk_tree_view_get_model(view);
+    GtkTreeIter iter;
+    gchar *filename;
+    gint64 line;
+
+    if (!gtk_tree_model_get_iter(model, &iter, path)) {
+        return;
+    }
+    gtk_tree_model_get(model, &iter, FIND_COLUMN_PATH, &filename, FIND_COLUMN_LINE, &line, -1);
+    open_file_at_line(filename, line);
+    g_free(filename);
+}
+
+void toggle_find_files(void) {
+    if (gtk_widget_get_visible(find.panel)) {
+        gtk_widget_hide(find.panel);
+        gtk_widget_grab_focus(editor->text_view);
+        return;
+    }
+    gtk_widget_show(find.panel);
+    gtk_widget_grab_focus(find.entry);
+}
+
+void setup_find_files(void) {
+    find.panel = gtk_box_new(GTK_ORIENTATION_VERTICAL, 6);
+    gtk_widget_set_size_request(find.panel, 320, -1);
+    gtk_widget_set_no_show_all(find.panel, TRUE);
+
+    find.entry = gtk_search_entry_new();
+    gtk_entry_set_placeholder_text(GTK_ENTRY(find.entry), "Find in files");
+    g_signal_connect(find.entry, "activate", G_CALLBACK(on_find_entry_activate), NULL);
+    gtk_box_pack_start(GTK_BOX(find.panel), find.entry, FALSE, FALSE, 0);
+
+    find.use_index = gtk_check_button_new_with_label("Use index");
+    gtk_widget_set_tooltip_text(find.use_index, "Keep a trigram index of the folder to narrow searches");
+    g_signal_connect(find.use_index, "toggled", G_CALLBACK(on_use_index_toggled), NULL);
+    gtk_box_pack_start(GTK_BOX(find.panel), find.use_index, FALSE, FALSE, 0);
+
+    find.label = gtk_label_new("");
+    gtk_label_set_xalign(GTK_LABEL(find.label), 0.0);
+    gtk_box_pack_start(GTK_BOX(find.panel), find.label, FALSE, FALSE, 0);
+
+    find.store = gtk_list_store_new(FIND_N_COLUMNS, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_INT64);
+    GtkWidget *tree = gtk_tree_view_new_with_model(GTK_TREE_MODEL(find.store));
+    g_object_unref(find.store);
+    gtk_tree_view_set_headers_visible(GTK_TREE_VIEW(tree), FALSE);
+    gtk_tree_view_set_activate_on_single_click(GTK_TREE_VIEW(tree), TRUE);
+    gtk_tree_view_insert_column_with_attributes(GTK_TREE_VIEW(tree), -1, "Location",
+                                                gtk_cell_renderer_text_new(), "text", FIND_COLUMN_LOCATION, NULL);
+    gtk_tree_view_insert_column_with_attributes(GTK_TREE_VIEW(tree), -1, "Text",
+                                                gtk_cell_renderer_text_new(), "text", FIND_COLUMN_TEXT, NULL);
+    g_signal_connect(tree, "row-activated", G_CALLBACK(on_result_activated), NULL);
+
+    GtkWidget *scrolled = gtk_scrolled_window_new(NULL, NULL);
+    gtk_container_add(GTK_CONTAINER(scrolled), tree);
+    gtk_box_pack_start(GTK_BOX(find.panel), scrolled, TRUE, TRUE, 0);
+
+    // The panel itself is no_show_all, so its children are shown up front
+    gtk_widget_show_all(scrolled);
+    gtk_widget_show(find.entry);
+    gtk_widget_show(find.use_index);
+    gtk_widget_show(find.label);
+
+    gtk_paned_pack1(GTK_PANED(editor->side_paned), find.panel, FALSE, FALSE);
+}
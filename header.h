@@ -4,40 +4,259 @@
 #include <gtk/gtk.h>
 #include <vte/vte.h>
 
+// Incrementally maintained document statistics (stats.c)
+typedef struct {
+    gint64 lines;
+    gint64 chars;
+    gint64 bytes;
+    gint64 words;
+} DocStats;
+
+// Piece-table mirror of the buffer with immutable, thread-safe snapshots (document.c)
+typedef struct _Document Document;
+typedef struct _DocSnapshot DocSnapshot;
+
+// Per-tab undo log of insert and delete deltas (undo.c)
+typedef struct _UndoHistory UndoHistory;
+
+// Per-tab crash-recovery log of unsaved edits (journal.c)
+typedef struct _Journal Journal;
+
+typedef struct {
+    DocSnapshot *snapshot;
+    guint piece;
+    gsize piece_start;
+} DocCursor;
+
 typedef struct {
     GtkWidget *window;
     GtkWidget *text_view;
+    GtkWidget *notebook;        // Document tabs above the shared text view
+    GtkWidget *overlay;         // Holds the text view and anything floated above it
     GtkTextBuffer *buffer;
     GtkWidget *status_bar;
-    GtkWidget *line_numbers;
     GtkWidget *header_bar;
     GtkWidget *search_bar;
     GtkWidget *search_entry;
+    GtkWidget *search_label;
+    GtkWidget *match_case_button;
+    GtkWidget *regex_button;
+    GtkWidget *replace_entry;
 
     // Terminal components
     GtkWidget *terminal;
     GtkWidget *terminal_container;
     GtkWidget *paned;
+    GtkWidget *side_paned;
     GtkWidget *terminal_button;
     gboolean terminal_visible;
+    gchar *terminal_cwd;        // Directory the shell starts in, NULL for the current one
+    gboolean prewarm_terminal;  // Start the shell right after the first frame instead of on first reveal
+
+    // File loading progress
+    GtkWidget *load_progress;
+    GtkWidget *load_cancel_button;
+    gboolean loading;
+    gboolean unloaded;          // The shown file was never read in (still loading, cancelled or failed); never save it
+    gint64 pending_goto_line;   // Line to move to once the loading file is complete, or -1
 
     gchar *current_file;
     gboolean is_modified;
+    guint64 change_seq;
     gboolean dark_mode;
-    gint zoom_level;
+    gdouble zoom_level;         // Text view font size in points
+    DocStats stats;
+    Document *document;
+
+    // Line number gutter (left border window of text_view)
+    gint gutter_digits;
+    gint64 gutter_line_offset;
+
+    // Read-only viewer for files above large_file_threshold bytes
+    GtkWidget *viewer_scrollbar;
+    guint64 large_file_threshold;
+
+    // Bytes of hidden clean tabs kept in memory before they are dropped and re-read from disk
+    guint64 document_budget;
+
+    // Bytes of undo history across all tabs before the oldest actions are dropped
+    guint64 undo_budget;
 } CodeEditor;
 
+// Files above this size are left out of find in files and the trigram index
+#define FIND_MAX_FILE_SIZE (16 * 1024 * 1024)
+
+// Dirty bits for the coalesced UI refresh (refresh.c)
+enum {
+    REFRESH_TITLE  = 1 << 0,
+    REFRESH_STATUS = 1 << 1,
+    REFRESH_GUTTER = 1 << 2,
+    REFRESH_SEARCH = 1 << 3,
+    REFRESH_HIGHLIGHT = 1 << 4,
+    REFRESH_FONT   = 1 << 5,
+    REFRESH_ALL    = REFRESH_TITLE | REFRESH_STATUS | REFRESH_GUTTER | REFRESH_SEARCH | REFRESH_HIGHLIGHT | REFRESH_FONT
+};
+
+// Latency histograms behind the performance overlay (perf.c)
+typedef enum {
+    PERF_KEY_TO_PAINT,
+    PERF_FRAME,
+    PERF_TEXT_CHANGED,          // Handlers from here on are ranked as "slowest handlers"
+    PERF_MARK_SET,
+    PERF_SEARCH_CHANGED,
+    PERF_REFRESH_TITLE,
+    PERF_REFRESH_STATUS,
+    PERF_REFRESH_GUTTER,
+    PERF_REFRESH_HIGHLIGHT,
+    PERF_REFRESH_SEARCH,
+    PERF_REFRESH_FONT,
+    PERF_APPLY_THEME,
+    PERF_GUTTER_DRAW,
+    PERF_N_METRICS
+} PerfMetric;
+
+// Adds the duration of call to a handler histogram
+#define PERF_TIME(metric, call) do { gint64 perf_start_ = perf_begin(); call; perf_end(metric, perf_start_); } while (0)
+
+// Times one startup phase when --startup-profile is on (trace.c)
+#define TRACE_PHASE(name, call) do { gint64 trace_start_ = trace_begin(); call; trace_end(name, trace_start_); } while (0)
+
 // Global editor instance
 extern CodeEditor *editor;
 
 // Function prototypes
 void setup_editor(void);
 void setup_terminal(void);
+void terminal_ensure(void);
+gchar *terminal_current_directory(void);
+void session_restore(gint64 started);
+void session_changed(void);
+void session_save(void);
+void session_close(void);
 void setup_ui(void);
 void setup_callbacks(void);
+void setup_theme(void);
 void apply_theme(void);
+guint theme_provider_count(void);
+void theme_apply_terminal(void);
 void update_status_bar(void);
 void update_window_title(void);
 void update_line_numbers(void);
+void set_zoom(gdouble size);
+void update_font(void);
+void trace_init(gint64 origin, const gchar *output);
+gint64 trace_begin(void);
+void trace_end(const gchar *name, gint64 start);
+void trace_counter(const gchar *name, gint64 value);
+void trace_watch_first_paint(GtkWidget *widget);
+void setup_perf(void);
+gint64 perf_begin(void);
+void perf_end(PerfMetric metric, gint64 start);
+void perf_record(PerfMetric metric, gint64 us);
+void toggle_perf_overlay(void);
+gboolean perf_dump_json(const gchar *path, GError **error);
+void schedule_refresh(guint flags);
+void flush_refresh(void);
+guint64 refresh_coalesced_count(void);
+void stats_attach(GtkTextBuffer *buffer, DocStats *stats);
+void stats_reset(DocStats *stats);
+gsize stats_count_newlines(const gchar *text, gsize len);
+void load_file_async(const gchar *filename);
+void cancel_file_load(void);
+void setup_viewer(void);
+gboolean viewer_open(const gchar *filename, GError **error);
+void viewer_close(void);
+gboolean viewer_is_active(void);
+gint64 viewer_line_count(void);
+void viewer_goto_line(gint64 line);
+void viewer_search(const gchar *needle, gboolean match_case, GRegex *regex);
+void viewer_search_next(gboolean backward);
+gchar *viewer_status_text(void);
+gboolean open_file(const gchar *filename);
+void open_file_at_line(const gchar *filename, gint64 line);
+void setup_documents(void);
+void documents_open(const gchar *filename);
+void documents_add(const gchar *filename, gint64 line, gint64 top_line);
+void documents_remove_blank(void);
+guint documents_get_count(void);
+gint documents_get_active(void);
+const gchar *documents_get_tab(guint index, gint64 *line, gint64 *top_line);
+void documents_new(void);
+void documents_close_current(void);
+void documents_update_label(void);
+const gchar *documents_get_active_filename(void);
+void documents_saved(const gchar *filename, guint64 change_seq);
+guint documents_unsaved_count(void);
+void documents_recover(const gchar *filename, DocSnapshot *text, Journal *journal);
+Document *document_attach(GtkTextBuffer *buffer);
+Document *document_new(void);
+void document_free(Document *doc);
+void document_insert(Document *doc, gsize char_offset, const gchar *text, gsize bytes);
+void document_delete(Document *doc, gsize char_start, gsize char_end);
+void document_clear(Document *doc);
+DocSnapshot *document_snapshot(Document *doc);
+DocSnapshot *doc_snapshot_ref(DocSnapshot *snapshot);
+DocSnapshot *doc_snapshot_slice(DocSnapshot *snapshot, gsize char_start, gsize char_end);
+void doc_snapshot_unref(DocSnapshot *snapshot);
+gsize doc_snapshot_get_length(DocSnapshot *snapshot);
+gsize doc_snapshot_get_char_count(DocSnapshot *snapshot);
+guint doc_snapshot_get_n_pieces(DocSnapshot *snapshot);
+const gchar *doc_snapshot_get_piece(DocSnapshot *snapshot, guint index, gsize *length);
+gchar *doc_snapshot_flatten(DocSnapshot *snapshot, gsize *length);
+void doc_cursor_init(DocCursor *cursor, DocSnapshot *snapshot);
+gboolean doc_cursor_equal(DocCursor *cursor, gsize offset, const gchar *text, gsize length, gboolean match_case);
+void undo_attach(GtkTextBuffer *buffer);
+UndoHistory *undo_history_new(void);
+void undo_history_free(UndoHistory *history);
+void undo_set_history(UndoHistory *history);
+gboolean undo_history_is_empty(UndoHistory *history);
+void undo_clear(void);
+void undo_begin_reload(void);
+void undo_end_reload(gboolean loaded);
+void undo_last(void);
+void redo_last(void);
+gsize undo_memory_used(void);
+void setup_journal(void);
+Journal *journal_new(void);
+void journal_free(Journal *j);
+void journal_set_active(Journal *j);
+Journal *journal_get_active(void);
+void journal_discard(Journal *j);
+void journal_recover(void);
+void journal_shutdown(void);
+void setup_search(void);
+void search_set_query(const gchar *query, gboolean match_case, gboolean use_regex);
+void search_clear(void);
+gboolean search_in_progress(void);
+void search_replace_all(const gchar *replacement);
+GRegex *search_compile_regex(const gchar *pattern, gboolean match_case, GRegexCompileFlags extra_flags, GError **error);
+void search_next(gboolean backward);
+void search_document_changed(void);
+void search_update_highlight(void);
+const gchar *search_find(const gchar *haystack, gsize length, const gchar *needle, gsize needle_length,
+                         gboolean match_case);
+const gchar *search_find_scalar(const gchar *haystack, gsize length, const gchar *needle, gsize needle_length,
+                                gboolean match_case);
+void on_find_next(GtkButton *button, gpointer data);
+void on_find_previous(GtkButton *button, gpointer data);
+void on_replace_all(GtkButton *button, gpointer data);
+void setup_find_files(void);
+void toggle_find_files(void);
+GPtrArray *find_files_load_ignores(const gchar *root);
+gboolean find_files_is_ignored(GPtrArray *ignore, const gchar *name);
+gboolean find_files_is_binary(const gchar *contents, gsize length);
+void setup_highlight(void);
+void highlight_set_file(const gchar *filename);
+void highlight_update(void);
+void highlight_apply_theme(void);
+const gchar *highlight_language_name(void);
+guint64 highlight_lines_lexed(void);
+gint64 highlight_longest_slice(void);
+void trigram_index_request(const gchar *root);
+GPtrArray *trigram_index_candidates(const gchar *root, const gchar *query);
+const gchar *trigram_index_status(const gchar *root);
+void save_file_async(const gchar *filename, gboolean close_after);
+gboolean save_in_progress(void);
+void goto_line(gint64 line);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,472 @@
+#include "header.h"
+
+#define HIGHLIGHT_MAX_LINE 20000    // Bytes lexed per line; the rest of an overlong line stays plain
+#define HIGHLIGHT_SLICE_US 4000     // Background lexing per idle dispatch, well inside a 16 ms frame
+
+// Lexer state at the end of a line
+enum {
+    STATE_NORMAL,
+    STATE_COMMENT,
+    STATE_TRIPLE_DOUBLE,
+    STATE_TRIPLE_SINGLE,
+    STATE_MASK = 0x7F,
+    STATE_DIRTY = 0x80          // Needs re-lexing; the low bits keep the old end state
+};
+
+enum {
+    HL_KEYWORD,
+    HL_TYPE,
+    HL_STRING,
+    HL_COMMENT,
+    HL_NUMBER,
+    HL_PREPROCESSOR,
+    HL_TAG,
+    HL_N_KINDS
+};
+
+typedef struct {
+    const gchar *name;
+    const gchar *extensions;        // Space separated
+    const gchar *keywords;
+    const gchar *types;
+    const gchar *line_comment;
+    const gchar *block_open;
+    const gchar *block_close;
+    const gchar *quotes;
+    gboolean triple_quotes;
+    gboolean preprocessor;
+    gboolean markup;
+    GHashTable *words;              // Built on first use: word -> kind + 1
+} Language;
+
+static Language languages[] = {
+    { "C", "c h",
+      "auto break case const continue default do else enum extern for goto if inline register restrict return "
+      "sizeof static struct switch typedef union volatile while NULL true false",
+      "void char short int long float double signed unsigned bool size_t ssize_t int8_t int16_t int32_t int64_t "
+      "uint8_t uint16_t uint32_t uint64_t gint gint64 guint guint64 gchar guchar gboolean gsize gssize gpointer",
+      "//", "/*", "*/", "\"'", FALSE, TRUE, FALSE, NULL },
+    { "C++", "cpp cc cxx hpp hh hxx",
+      "auto break case catch class const constexpr continue default delete do else enum explicit extern for friend "
+      "goto if inline mutable namespace new noexcept nullptr operator override private protected public return "
+      "sizeof static static_cast struct switch template this throw try typedef typename union using virtual "
+      "volatile while true false",
+      "void char short int long float double signed unsigned bool size_t std string vector map int32_t int64_t "
+      "uint8_t uint32_t uint64_t",
+      "//", "/*", "*/", "\"'", FALSE, TRUE, FALSE, NULL },
+    { "Python", "py pyw",
+      "and as assert async await break class continue def del elif else except finally for from global if import "
+      "in is lambda nonlocal not or pass raise return try while with yield None True False self",
+      "int str float list dict set tuple bool bytes object",
+      "#", NULL, NULL, "\"'", TRUE, FALSE, FALSE, NULL },
+    { "JavaScript", "js mjs cjs jsx",
+      "async await break case catch class const continue debugger default delete do else export extends finally "
+      "for function if import in instanceof let new of return super switch this throw try typeof var void while "
+      "with yield null undefined true false",
+      "Array Object String Number Boolean Promise Map Set",
+      "//", "/*", "*/", "\"'`", FALSE, FALSE, FALSE, NULL },
+    { "Java", "java",
+      "abstract assert break case catch class continue default do else enum extends final finally for if "
+      "implements import instanceof interface native new package private protected public return static super "
+      "switch synchronized this throw throws try volatile while null true false",
+      "boolean byte char double float int long short void var String Object Integer List Map",
+      "//", "/*", "*/", "\"'", FALSE, FALSE, FALSE, NULL },
+    { "CSS", "css",
+      "important", "",
+      NULL, "/*", "*/", "\"'", FALSE, FALSE, FALSE, NULL },
+    { "HTML", "html htm xml",
+      "", "",
+      NULL, "<!--", "-->", "\"", FALSE, FALSE, TRUE, NULL },
+};
+
+typedef struct {
+    GtkTextIter iter;       // Position of counted in the buffer
+    const gchar *counted;
+} LineLexer;
+
+static struct {
+    Language *language;     // NULL when the current file has no highlighting
+    GtkTextTag *tags[HL_N_KINDS];
+    GArray *states;         // guint8 per buffer line
+    gint fill_from;         // No dirty line sits above this one
+    guint fill_source;
+    gint insert_line;
+    guint64 lines_lexed;
+    gint64 longest_slice;   // Microseconds spent in the slowest background slice
+} highlight;
+
+static const gchar *tag_names[HL_N_KINDS] = {
+    "hl-keyword", "hl-type", "hl-string", "hl-comment", "hl-number", "hl-preprocessor", "hl-tag"
+};
+static const gchar *dark_colors[HL_N_KINDS] = {
+    "#569cd6", "#4ec9b0", "#ce9178", "#6a9955", "#b5cea8", "#c586c0", "#569cd6"
+};
+static const gchar *light_colors[HL_N_KINDS] = {
+    "#0000ff", "#267f99", "#a31515", "#008000", "#098658", "#af00db", "#800000"
+};
+
+static void mark_dirty(gint line) {
+    if (line < (gint) highlight.states->len) {
+        g_array_index(highlight.states, guint8, line) |= STATE_DIRTY;
+    }
+    highlight.fill_from = MIN(highlight.fill_from, line);
+    if (highlight.language) {
+        schedule_refresh(REFRESH_HIGHLIGHT);
+    }
+}
+
+static gint word_kind(Language *language, const gchar *word, gsize length) {
+    gchar buffer[32];
+
+    if (!language->words) {
+        const gchar *lists[] = { language->keywords, language->types };
+        language->words = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+        for (gint kind = HL_KEYWORD; kind <= HL_TYPE; kind++) {
+            gchar **words = g_strsplit(lists[kind], " ", -1);
+            for (gchar **w = words; *w; w++) {
+                if (**w) {
+                    g_hash_table_insert(language->words, g_strdup(*w), GINT_TO_POINTER(kind + 1));
+                }
+            }
+            g_strfreev(words);
+        }
+    }
+    if (length >= sizeof(buffer)) {
+        return -1;
+    }
+    memcpy(buffer, word, length);
+    buffer[length] = '\0';
+    return GPOINTER_TO_INT(g_hash_table_lookup(language->words, buffer)) - 1;
+}
+
+static void emit(LineLexer *lx, const gchar *start, const gchar *end, gint kind) {
+    GtkTextIter token_end;
+
+    gtk_text_iter_forward_chars(&lx->iter, g_utf8_strlen(lx->counted, start - lx->counted));
+    token_end = lx->iter;
+    gtk_text_iter_forward_chars(&token_end, g_utf8_strlen(start, end - start));
+    gtk_text_buffer_apply_tag(editor->buffer, highlight.tags[kind], &lx->iter, &token_end);
+    lx->iter = token_end;
+    lx->counted = end;
+}
+
+static gboolean starts_with(const gchar *p, const gchar *end, const gchar *prefix) {
+    gsize length = strlen(prefix);
+    return (gsize) (end - p) >= length && memcmp(p, prefix, length) == 0;
+}
+
+static const gchar *find_text(const gchar *p, const gchar *end, const gchar *needle) {
+    return search_find(p, end - p, needle, strlen(needle), TRUE);
+}
+
+// Tags one line and returns the state it leaves for the next
+static guint8 lex(Language *lang, LineLexer *lx, const gchar *p, const gchar *end, guint8 state) {
+    // Finish a construct left open by an earlier line
+    if (state != STATE_NORMAL) {
+        const gchar *close = state == STATE_COMMENT ? lang->block_close : state == STATE_TRIPLE_DOUBLE ? "\"\"\"" : "'''";
+        const gchar *found = close ? find_text(p, end, close) : p;
+        if (!found) {
+            emit(lx, p, end, state == STATE_COMMENT ? HL_COMMENT : HL_STRING);
+            return state;
+        }
+        found += close ? strlen(close) : 0;
+        emit(lx, p, found, state == STATE_COMMENT ? HL_COMMENT : HL_STRING);
+        p = found;
+    }
+
+    // Directives run to the end of the line or to a comment
+    if (lang->preprocessor) {
+        const gchar *q = p;
+        while (q < end && g_ascii_isspace(*q)) {
+            q++;
+        }
+        if (q < end && *q == '#') {
+            const gchar *block = find_text(q, end, lang->block_open);
+            const gchar *line = find_text(q, end, lang->line_comment);
+            const gchar *stop = block && (!line || block < line) ? block : line ? line : end;
+            emit(lx, q, stop, HL_PREPROCESSOR);
+            p = stop;
+        }
+    }
+
+    while (p < end) {
+        gchar c = *p;
+
+        if (lang->block_open && starts_with(p, end, lang->block_open)) {
+            const gchar *close = find_text(p + strlen(lang->block_open), end, lang->block_close);
+            if (!close) {
+                emit(lx, p, end, HL_COMMENT);
+                return STATE_COMMENT;
+            }
+            emit(lx, p, close + strlen(lang->block_close), HL_COMMENT);
+            p = close + strlen(lang->block_close);
+        } else if (lang->line_comment && starts_with(p, end, lang->line_comment)) {
+            emit(lx, p, end, HL_COMMENT);
+            return STATE_NORMAL;
+        } else if (lang->triple_quotes && (starts_with(p, end, "\"\"\"") || starts_with(p, end, "'''"))) {
+            const gchar *close = find_text(p + 3, end, c == '"' ? "\"\"\"" : "'''");
+            if (!close) {
+                emit(lx, p, end, HL_STRING);
+                return c == '"' ? STATE_TRIPLE_DOUBLE : STATE_TRIPLE_SINGLE;
+            }
+            emit(lx, p, close + 3, HL_STRING);
+            p = close + 3;
+        } else if (c && strchr(lang->quotes, c)) {
+            const gchar *q = p + 1;
+            while (q < end && *q != c) {
+                q += *q == '\\' && q + 1 < end ? 2 : 1;
+            }
+            q = MIN(q + 1, end);
+            emit(lx, p, q, HL_STRING);
+            p = q;
+        } else if (lang->markup && c == '<' && p + 1 < end && (g_ascii_isalpha(p[1]) || p[1] == '/' || p[1] == '!')) {
+            const gchar *q = p + 2;
+            while (q < end && (g_ascii_isalnum(*q) || *q == '-' || *q == ':')) {
+                q++;
+            }
+            emit(lx, p, q, HL_TAG);
+            p = q;
+        } else if (g_ascii_isdigit(c)) {
+            const gchar *q = p;
+            while (q < end && (g_ascii_isalnum(*q) || *q == '.' || *q == '_')) {
+                q++;
+            }
+            emit(lx, p, q, HL_NUMBER);
+            p = q;
+        } else if (g_ascii_isalpha(c) || c == '_' || c == '$') {
+            const gchar *q = p;
+            while (q < end && (g_ascii_isalnum(*q) || *q == '_' || *q == '$')) {
+                q++;
+            }
+            gint kind = word_kind(lang, p, q - p);
+            if (kind >= 0) {
+                emit(lx, p, q, kind);
+            }
+            p = q;
+        } else {
+            p++;
+        }
+    }
+    return STATE_NORMAL;
+}
+
+static guint8 lex_line(gint line, guint8 state) {
+    GtkTextIter start, end;
+
+    gtk_text_buffer_get_iter_at_line(editor->buffer, &start, line);
+    end = start;
+    if (!gtk_text_iter_ends_line(&end)) {
+        gtk_text_iter_forward_to_line_end(&end);
+    }
+    for (gint kind = 0; kind < HL_N_KINDS; kind++) {
+        gtk_text_buffer_remove_tag(editor->buffer, highlight.tags[kind], &start, &end);
+    }
+
+    gchar *text = gtk_text_iter_get_slice(&start, &end);
+    gsize length = strlen(text);
+    if (length > HIGHLIGHT_MAX_LINE) {
+        length = g_utf8_find_prev_char(text, text + HIGHLIGHT_MAX_LINE + 1) - text;
+    }
+    LineLexer lx = { start, text };
+    state = lex(highlight.language, &lx, text, text + length, state);
+    g_free(text);
+    highlight.lines_lexed++;
+    return state;
+}
+
+// Lexes the dirty lines in [first, last] and returns where it stopped once the deadline (if any) passed.
+// A line whose end state changed dirties the next one, so re-lexing stops as soon as the states converge.
+static gint lex_dirty(gint first, gint last, gint64 deadline) {
+    guint8 *states = (guint8 *) highlight.states->data;
+    gint n_lines = highlight.states->len;
+
+    for (gint line = first; line <= last; line++) {
+        if (!(states[line] & STATE_DIRTY)) {
+            continue;
+        }
+        if (deadline && g_get_monotonic_time() >= deadline) {
+            return line;
+        }
+        guint8 old = states[line] & STATE_MASK;
+        states[line] = lex_line(line, line > 0 ? states[line - 1] & STATE_MASK : STATE_NORMAL);
+        if (states[line] != old && line + 1 < n_lines) {
+            states[line + 1] |= STATE_DIRTY;
+        }
+    }
+    return last + 1;
+}
+
+// Background fill: everything off screen, a time slice per low-priority idle
+static gboolean on_highlight_fill(gpointer data) {
+    gint64 started = g_get_monotonic_time();
+    const guint8 *states = (const guint8 *) highlight.states->data;
+    gint n_lines = highlight.states->len;
+
+    while (highlight.fill_from < n_lines && !(states[highlight.fill_from] & STATE_DIRTY)) {
+        highlight.fill_from++;
+    }
+    if (highlight.language && highlight.fill_from < n_lines) {
+        highlight.fill_from = lex_dirty(highlight.fill_from, n_lines - 1, started + HIGHLIGHT_SLICE_US);
+    }
+    highlight.longest_slice = MAX(highlight.longest_slice, g_get_monotonic_time() - started);
+
+    if (!highlight.language || highlight.fill_from >= n_lines) {
+        highlight.fill_source = 0;
+        return G_SOURCE_REMOVE;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+// Lexes the visible lines right away and leaves the rest of the document to the background fill
+void highlight_update(void) {
+    gint n_lines = gtk_text_buffer_get_line_count(editor->buffer);
+
+    if ((gint) highlight.states->len != n_lines) {
+        // Out of step with the buffer; start over from a clean array
+        g_array_set_size(highlight.states, n_lines);
+        memset(highlight.states->data, STATE_DIRTY, n_lines);
+        highlight.fill_from = 0;
+    }
+    if (!highlight.language) {
+        return;
+    }
+
+    GtkTextView *view = GTK_TEXT_VIEW(editor->text_view);
+    GdkRectangle visible;
+    GtkTextIter top, bottom;
+    gtk_text_view_get_visible_rect(view, &visible);
+    gtk_text_view_get_line_at_y(view, &top, visible.y, NULL);
+    gtk_text_view_get_line_at_y(view, &bottom, visible.y + visible.height, NULL);
+    lex_dirty(gtk_text_iter_get_line(&top), gtk_text_iter_get_line(&bottom), 0);
+
+    if (highlight.fill_from < n_lines && !highlight.fill_source) {
+        highlight.fill_source = g_idle_add_full(G_PRIORITY_LOW, on_highlight_fill, NULL, NULL);
+    }
+}
+
+static void on_highlight_insert_text(GtkTextBuffer *buffer, GtkTextIter *location,
+                                     gchar *text, gint len, gpointer data) {
+    highlight.insert_line = gtk_text_iter_get_line(location);
+}
+
+// Runs after the insert, when location sits at the end of the new text
+static void on_highlight_inserted_text(GtkTextBuffer *buffer, GtkTextIter *location,
+                                       gchar *text, gint len, gpointer data) {
+    gint start = highlight.insert_line;
+    gint added = gtk_text_iter_get_line(location) - start;
+
+    // The old end state now belongs to the last of the split lines; the new ones start dirty
+    if (added > 0) {
+        guint8 *fresh = g_malloc(added);
+        memset(fresh, STATE_DIRTY, added);
+        g_array_insert_vals(highlight.states, MIN(start, (gint) highlight.states->len), fresh, added);
+        g_free(fresh);
+    }
+    mark_dirty(start + added);
+    highlight.fill_from = MIN(highlight.fill_from, start);
+}
+
+static void on_highlight_delete_range(GtkTextBuffer *buffer, GtkTextIter *start,
+                                      GtkTextIter *end, gpointer data) {
+    gint first = gtk_text_iter_get_line(start);
+    gint removed = gtk_text_iter_get_line(end) - first;
+
+    // Keep the end state of the last deleted line, which is where the merged line now ends
+    if (removed > 0) {
+        g_array_remove_range(highlight.states, first, MIN(removed, (gint) highlight.states->len - first - 1));
+    }
+    mark_dirty(first);
+}
+
+static void on_highlight_view_scrolled(GtkAdjustment *adjustment, gpointer data) {
+    // Only matters while part of the document is still waiting for the fill
+    if (highlight.fill_source) {
+        schedule_refresh(REFRESH_HIGHLIGHT);
+    }
+}
+
+static Language *language_for_file(const gchar *filename) {
+    const gchar *dot = filename ? strrchr(filename, '.') : NULL;
+
+    if (!dot || strchr(dot, G_DIR_SEPARATOR)) {
+        return NULL;
+    }
+    gchar *extension = g_ascii_strdown(dot + 1, -1);
+    Language *found = NULL;
+    for (guint i = 0; i < G_N_ELEMENTS(languages) && !found; i++) {
+        gchar **extensions = g_strsplit(languages[i].extensions, " ", -1);
+        if (g_strv_contains((const gchar *const *) extensions, extension)) {
+            found = &languages[i];
+        }
+        g_strfreev(extensions);
+    }
+    g_free(extension);
+    return found;
+}
+
+// Picks the language from the file name and re-highlights the whole buffer
+void highlight_set_file(const gchar *filename) {
+    Language *language = language_for_file(filename);
+    GtkTextIter start, end;
+
+    if (language == highlight.language) {
+        return;
+    }
+    highlight.language = language;
+    if (!language && highlight.fill_source) {
+        g_source_remove(highlight.fill_source);
+        highlight.fill_source = 0;
+    }
+    gtk_text_buffer_get_bounds(editor->buffer, &start, &end);
+    for (gint kind = 0; kind < HL_N_KINDS; kind++) {
+        gtk_text_buffer_remove_tag(editor->buffer, highlight.tags[kind], &start, &end);
+    }
+    memset(highlight.states->data, STATE_DIRTY, highlight.states->len);
+    mark_dirty(0);
+}
+
+const gchar *highlight_language_name(void) {
+    return highlight.language ? highlight.language->name : NULL;
+}
+
+guint64 highlight_lines_lexed(void) {
+    return highlight.lines_lexed;
+}
+
+gint64 highlight_longest_slice(void) {
+    return highlight.longest_slice;
+}
+
+void highlight_apply_theme(void) {
+    const gchar **colors = editor->dark_mode ? dark_colors : light_colors;
+
+    if (!highlight.tags[0]) {
+        return;
+    }
+    for (gint kind = 0; kind < HL_N_KINDS; kind++) {
+        g_object_set(highlight.tags[kind], "foreground", colors[kind], NULL);
+    }
+}
+
+void setup_highlight(void) {
+    guint8 state = STATE_DIRTY;
+
+    // One shared tag per token kind; the pool never grows with the document
+    for (gint kind = 0; kind < HL_N_KINDS; kind++) {
+        highlight.tags[kind] = gtk_text_buffer_create_tag(editor->buffer, tag_names[kind], NULL);
+    }
+    g_object_set(highlight.tags[HL_COMMENT], "style", PANGO_STYLE_ITALIC, NULL);
+    highlight_apply_theme();
+
+    highlight.states = g_array_new(FALSE, FALSE, sizeof(guint8));
+    g_array_append_val(highlight.states, state);
+
+    g_signal_connect(editor->buffer, "insert-text", G_CALLBACK(on_highlight_insert_text), NULL);
+    g_signal_connect_after(editor->buffer, "insert-text", G_CALLBACK(on_highlight_inserted_text), NULL);
+    g_signal_connect(editor->buffer, "delete-range", G_CALLBACK(on_highlight_delete_range), NULL);
+
+    // Scrolling moves the window that is lexed ahead of the background fill
+    GtkAdjustment *vadjustment = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(editor->text_view));
+    g_signal_connect(vadjustment, "value-changed", G_CALLBACK(on_highlight_view_scrolled), NULL);
+    g_signal_connect(vadjustment, "changed", G_CALLBACK(on_highlight_view_scrolled), NULL);
+}
@@ -0,0 +1,524 @@
+#include "header.h"
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+
+#define JOURNAL_MAGIC "CODEPAD-JOURNAL 1"
+#define JOURNAL_FLUSH_INTERVAL 1                    // Seconds between batched, fsynced appends
+#define JOURNAL_COMPACT_MIN (1024 * 1024)           // Never rewrite a journal smaller than this
+#define JOURNAL_RECORD_HEADER (1 + 2 * sizeof(guint64))
+
+/*
+ * Write-ahead recovery log of one tab's edits, created on its first edit. After a text header
+ * (owner pid, file, size and mtime of the file the edits apply to) come binary records; when the
+ * file could not be stat'ed, the first record is an 'S' instead:
+ *   'I' offset bytes text    insert text at a char offset
+ *   'D' offset chars         delete chars at a char offset
+ *   'S' bytes text           the whole text; compaction writes one in place of everything before
+ */
+struct _Journal {
+    gchar *path;                // Recovery file, NULL until the first edit
+    gchar *header;
+    gint fd;                    // -1 until the writer has created the file
+    GByteArray *pending;        // Records waiting for the next flush
+    guint64 written;            // Bytes in the file; compaction is due once it dwarfs the text
+    struct _JournalWrite *job;  // In flight, at most one per journal
+};
+
+typedef struct _JournalWrite {
+    Journal *journal;           // NULL once the tab is gone
+    gchar *path;
+    gchar *header;
+    gint fd;
+    GBytes *data;               // Records to append, or
+    DocSnapshot *snapshot;      // text to rewrite the whole file with
+    gboolean discard;           // The edits were saved or dropped while this write was in flight
+    guint64 written;
+} JournalWrite;
+
+static struct {
+    gchar *dir;
+    GPtrArray *journals;
+    Journal *active;            // Journal of the shown tab; NULL while its text is being replaced
+    guint flush_source;
+} journal;
+
+static void free_write(gpointer data) {
+    JournalWrite *job = data;
+
+    g_free(job->path);
+    g_free(job->header);
+    if (job->data) {
+        g_bytes_unref(job->data);
+    }
+    if (job->snapshot) {
+        doc_snapshot_unref(job->snapshot);
+    }
+    g_free(job);
+}
+
+static gboolean write_all(gint fd, const gchar *data, gsize length) {
+    while (length > 0) {
+        gssize n = write(fd, data, length);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return FALSE;
+        }
+        data += n;
+        length -= n;
+    }
+    return TRUE;
+}
+
+static void put_record_header(gchar *out, gchar kind, guint64 a, guint64 b) {
+    guint64 le_a = GUINT64_TO_LE(a), le_b = GUINT64_TO_LE(b);
+
+    out[0] = kind;
+    memcpy(out + 1, &le_a, sizeof(le_a));
+    memcpy(out + 1 + sizeof(le_a), &le_b, sizeof(le_b));
+}
+
+// Compaction: header and one 'S' record in a temporary file that then replaces the journal
+static gint rewrite_journal(JournalWrite *job, GError **error) {
+    gchar *tmp = g_strconcat(job->path, ".tmp", NULL);
+    gsize length = doc_snapshot_get_length(job->snapshot);
+    gchar record[JOURNAL_RECORD_HEADER];
+    gint fd = g_open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    gboolean ok = fd >= 0;
+
+    // 'S' carries only a length; the second field is unused
+    put_record_header(record, 'S', length, 0);
+    ok = ok && write_all(fd, job->header, strlen(job->header)) && write_all(fd, record, sizeof(record));
+    for (guint i = 0; ok && i < doc_snapshot_get_n_pieces(job->snapshot); i++) {
+        gsize piece_length;
+        const gchar *piece = doc_snapshot_get_piece(job->snapshot, i, &piece_length);
+        ok = write_all(fd, piece, piece_length);
+    }
+    ok = ok && fsync(fd) == 0 && g_rename(tmp, job->path) == 0;
+
+    if (!ok) {
+        gint saved_errno = errno;
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno), "%s: %s", tmp, g_strerror(saved_errno));
+        if (fd >= 0) {
+            close(fd);
+            g_unlink(tmp);
+        }
+        g_free(tmp);
+        return -1;
+    }
+    job->written = strlen(job->header) + sizeof(record) + length;
+    g_free(tmp);
+    return fd;
+}
+
+static void write_thread(GTask *task, gpointer source, gpointer task_data, GCancellable *cancellable) {
+    JournalWrite *job = task_data;
+
+    if (job->snapshot) {
+        GError *error = NULL;
+        gint fd = rewrite_journal(job, &error);
+        if (fd < 0) {
+            g_task_return_error(task, error);
+            return;
+        }
+        if (job->fd >= 0) {
+            close(job->fd);
+        }
+        job->fd = fd;
+        g_task_return_boolean(task, TRUE);
+        return;
+    }
+
+    if (job->fd < 0) {
+        job->fd = g_open(job->path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    }
+    gsize length;
+    const gchar *data = g_bytes_get_data(job->data, &length);
+    if (job->fd < 0 || !write_all(job->fd, data, length) || fsync(job->fd) != 0) {
+        gint saved_errno = errno;
+        g_task_return_new_error(task, G_FILE_ERROR, g_file_error_from_errno(saved_errno),
+                                "%s: %s", job->path, g_strerror(saved_errno));
+        return;
+    }
+    job->written = length;
+    g_task_return_boolean(task, TRUE);
+}
+
+static void schedule_flush(void);
+
+static void on_write_done(GObject *source, GAsyncResult *result, gpointer data) {
+    JournalWrite *job = g_task_get_task_data(G_TASK(result));
+    Journal *owner = job->journal;
+    GError *error = NULL;
+    gboolean ok = g_task_propagate_boolean(G_TASK(result), &error);
+
+    if (owner) {
+        owner->job = NULL;
+    }
+    // Nothing left to recover from this file
+    if (!owner || job->discard) {
+        if (job->fd >= 0) {
+            close(job->fd);
+        }
+        g_unlink(job->path);
+        g_clear_error(&error);
+        return;
+    }
+
+    owner->fd = job->fd;
+    if (ok) {
+        owner->written = job->snapshot ? job->written : owner->written + job->written;
+    } else {
+        // The batch is lost; the next flush tries again with the records that follow
+        g_warning("Could not write recovery journal %s", error->message);
+        g_error_free(error);
+    }
+    if (owner->pending->len > 0) {
+        schedule_flush();
+    }
+}
+
+static void start_write(Journal *j, DocSnapshot *snapshot) {
+    JournalWrite *job = g_new0(JournalWrite, 1);
+
+    job->journal = j;
+    job->path = g_strdup(j->path);
+    job->header = g_strdup(j->header);
+    job->fd = j->fd;
+    if (snapshot) {
+        // The text already includes whatever was pending
+        job->snapshot = snapshot;
+        g_byte_array_set_size(j->pending, 0);
+    } else {
+        job->data = g_byte_array_free_to_bytes(j->pending);
+        j->pending = g_byte_array_new();
+    }
+    j->job = job;
+
+    GTask *task = g_task_new(NULL, NULL, on_write_done, NULL);
+    g_task_set_task_data(task, job, free_write);
+    g_task_run_in_thread(task, write_thread);
+    g_object_unref(task);
+}
+
+// Rewriting costs the whole text, so it waits until the appended edits are twice its size
+static gboolean compaction_due(Journal *j) {
+    return j == journal.active && !editor->loading &&
+           j->written > MAX(JOURNAL_COMPACT_MIN, 2 * (guint64) gtk_text_buffer_get_char_count(editor->buffer));
+}
+
+static gboolean on_flush_timeout(gpointer data) {
+    gboolean waiting = FALSE;
+
+    for (guint i = 0; i < journal.journals->len; i++) {
+        Journal *j = g_ptr_array_index(journal.journals, i);
+        if (j->pending->len == 0) {
+            continue;
+        }
+        if (j->job) {
+            waiting = TRUE;
+        } else {
+            start_write(j, compaction_due(j) ? document_snapshot(editor->document) : NULL);
+        }
+    }
+    if (!waiting) {
+        journal.flush_source = 0;
+    }
+    return waiting ? G_SOURCE_CONTINUE : G_SOURCE_REMOVE;
+}
+
+static void schedule_flush(void) {
+    if (!journal.flush_source) {
+        journal.flush_source = g_timeout_add_seconds(JOURNAL_FLUSH_INTERVAL, on_flush_timeout, NULL);
+    }
+}
+
+// The first edit names the file and records what the edits apply to; FALSE if that is not on disk
+static gboolean begin_journal(Journal *j) {
+    GString *header = g_string_new(JOURNAL_MAGIC "\n");
+    gchar *uuid = g_uuid_string_random();
+    gchar *basename = g_strconcat(uuid, ".journal", NULL);
+    gboolean have_base = TRUE;
+    GStatBuf st;
+
+    g_string_append_printf(header, "pid %d\n", (gint) getpid());
+    if (editor->current_file) {
+        gchar *escaped = g_strescape(editor->current_file, NULL);
+        g_string_append_printf(header, "path %s\n", escaped);
+        g_free(escaped);
+        have_base = g_stat(editor->current_file, &st) == 0;
+        if (have_base) {
+            g_string_append_printf(header, "base %" G_GINT64_FORMAT " %" G_GINT64_FORMAT "\n",
+                                   (gint64) st.st_size, (gint64) st.st_mtime);
+        }
+    }
+    g_string_append_c(header, '\n');
+
+    j->path = g_build_filename(journal.dir, basename, NULL);
+    j->header = g_string_free(header, FALSE);
+    j->written = 0;
+    g_byte_array_append(j->pending, (const guint8 *) j->header, strlen(j->header));
+    g_free(basename);
+    g_free(uuid);
+    return have_base;
+}
+
+static void append_record(gchar kind, guint64 a, guint64 b, const gchar *payload, gsize length) {
+    Journal *j = journal.active;
+    gchar record[JOURNAL_RECORD_HEADER];
+
+    if (!j->path && !begin_journal(j)) {
+        // Nothing to replay onto, so start from the whole text; the document already holds this edit
+        DocSnapshot *text = document_snapshot(editor->document);
+        put_record_header(record, 'S', doc_snapshot_get_length(text), 0);
+        g_byte_array_append(j->pending, (const guint8 *) record, sizeof(record));
+        for (guint i = 0; i < doc_snapshot_get_n_pieces(text); i++) {
+            gsize piece_length;
+            const gchar *piece = doc_snapshot_get_piece(text, i, &piece_length);
+            g_byte_array_append(j->pending, (const guint8 *) piece, piece_length);
+        }
+        doc_snapshot_unref(text);
+        schedule_flush();
+        return;
+    }
+    put_record_header(record, kind, a, b);
+    g_byte_array_append(j->pending, (const guint8 *) record, sizeof(record));
+    g_byte_array_append(j->pending, (const guint8 *) payload, length);
+    schedule_flush();
+}
+
+static gboolean journaling(void) {
+    return journal.active && !editor->loading;
+}
+
+// After the buffer has taken the text, so location is its end
+static void on_journal_insert_text(GtkTextBuffer *buffer, GtkTextIter *location, gchar *text, gint len, gpointer data) {
+    if (journaling() && len > 0) {
+        guint64 offset = gtk_text_iter_get_offset(location) - g_utf8_strlen(text, len);
+        append_record('I', offset, len, text, len);
+    }
+}
+
+static void on_journal_delete_range(GtkTextBuffer *buffer, GtkTextIter *start, GtkTextIter *end, gpointer data) {
+    if (journaling() && !gtk_text_iter_equal(start, end)) {
+        guint64 offset = gtk_text_iter_get_offset(start);
+        append_record('D', offset, gtk_text_iter_get_offset(end) - offset, NULL, 0);
+    }
+}
+
+Journal *journal_new(void) {
+    Journal *j = g_new0(Journal, 1);
+
+    j->fd = -1;
+    j->pending = g_byte_array_new();
+    g_ptr_array_add(journal.journals, j);
+    return j;
+}
+
+// The edits are on disk or no longer wanted; the next edit starts a new journal
+void journal_discard(Journal *j) {
+    if (!j || !j->path) {
+        return;
+    }
+    g_byte_array_set_size(j->pending, 0);
+    if (j->job) {
+        j->job->discard = TRUE;
+    } else if (j->fd >= 0) {
+        close(j->fd);
+    }
+    g_unlink(j->path);
+    g_clear_pointer(&j->path, g_free);
+    g_clear_pointer(&j->header, g_free);
+    j->fd = -1;
+    j->written = 0;
+}
+
+void journal_free(Journal *j) {
+    journal_discard(j);
+    if (j->job) {
+        j->job->journal = NULL;
+    }
+    if (journal.active == j) {
+        journal.active = NULL;
+    }
+    g_ptr_array_remove(journal.journals, j);
+    g_byte_array_free(j->pending, TRUE);
+    g_free(j);
+}
+
+void journal_set_active(Journal *j) {
+    journal.active = j;
+}
+
+Journal *journal_get_active(void) {
+    return journal.active;
+}
+
+// A clean exit means every tab was saved or knowingly dropped
+void journal_shutdown(void) {
+    for (guint i = 0; i < journal.journals->len; i++) {
+        journal_discard(g_ptr_array_index(journal.journals, i));
+    }
+}
+
+// Another running instance still owns journals stamped with its pid
+static gboolean owner_alive(gint pid) {
+    return pid > 0 && pid != getpid() && (kill(pid, 0) == 0 || errno == EPERM);
+}
+
+// Applies the records after the header and returns how many it applied, or -1 if the base text
+// could not be established
+static gint replay(Document *doc, const gchar *data, gsize length, const gchar *filename,
+                   gint64 base_size, gint64 base_mtime) {
+    gboolean have_base = FALSE;
+    gint applied = 0;
+    gsize pos = 0;
+
+    while (pos + JOURNAL_RECORD_HEADER <= length) {
+        gchar kind = data[pos];
+        guint64 a, b;
+        memcpy(&a, data + pos + 1, sizeof(a));
+        memcpy(&b, data + pos + 1 + sizeof(a), sizeof(b));
+        a = GUINT64_FROM_LE(a);
+        b = GUINT64_FROM_LE(b);
+        pos += JOURNAL_RECORD_HEADER;
+
+        // Edits before the first snapshot apply to the file as it was when the journal began
+        if (kind != 'S' && !have_base) {
+            if (filename) {
+                GStatBuf st;
+                gchar *contents;
+                gsize contents_length;
+                if (g_stat(filename, &st) != 0 || st.st_size != base_size || (gint64) st.st_mtime != base_mtime ||
+                    !g_file_get_contents(filename, &contents, &contents_length, NULL)) {
+                    return -1;
+                }
+                document_insert(doc, 0, contents, contents_length);
+                g_free(contents);
+            }
+            have_base = TRUE;
+        }
+
+        // A torn record at the end is the write the crash interrupted
+        DocSnapshot *text = document_snapshot(doc);
+        gsize chars = doc_snapshot_get_char_count(text);
+        doc_snapshot_unref(text);
+        if (kind == 'S' && pos + a <= length) {
+            document_clear(doc);
+            document_insert(doc, 0, data + pos, a);
+            pos += a;
+            have_base = TRUE;
+        } else if (kind == 'I' && pos + b <= length && a <= chars) {
+            document_insert(doc, a, data + pos, b);
+            pos += b;
+        } else if (kind == 'D' && a + b <= chars) {
+            document_delete(doc, a, a + b);
+        } else {
+            break;
+        }
+        applied++;
+    }
+    return applied;
+}
+
+// Reopens the unsaved edits of a previous run that did not exit cleanly
+void journal_recover(void) {
+    GDir *dir = g_dir_open(journal.dir, 0, NULL);
+    GPtrArray *names;
+    const gchar *name;
+
+    if (!dir) {
+        return;
+    }
+    names = g_ptr_array_new_with_free_func(g_free);
+    // Listed up front: recovered journals are rewritten in place while the list is worked through
+    while ((name = g_dir_read_name(dir))) {
+        if (g_str_has_suffix(name, ".journal")) {
+            g_ptr_array_add(names, g_strdup(name));
+        }
+    }
+    g_dir_close(dir);
+
+    for (guint i = 0; i < names->len; i++) {
+        name = g_ptr_array_index(names, i);
+        gchar *path = g_build_filename(journal.dir, name, NULL);
+        gchar *contents = NULL, *filename = NULL;
+        gsize length;
+        gint pid = 0;
+        gint64 base_size = -1, base_mtime = 0;
+
+        if (!g_file_get_contents(path, &contents, &length, NULL) || !g_str_has_prefix(contents, JOURNAL_MAGIC "\n")) {
+            g_free(contents);
+            g_free(path);
+            continue;
+        }
+
+        // Header lines up to the first empty one
+        gchar *body = strstr(contents, "\n\n");
+        gchar *header_text = body ? g_strndup(contents, body - contents) : g_strdup("");
+        gchar **lines = g_strsplit(header_text, "\n", -1);
+        g_free(header_text);
+        for (gint k = 1; lines[k]; k++) {
+            if (g_str_has_prefix(lines[k], "pid ")) {
+                pid = atoi(lines[k] + 4);
+            } else if (g_str_has_prefix(lines[k], "path ")) {
+                filename = g_strcompress(lines[k] + 5);
+            } else if (g_str_has_prefix(lines[k], "base ")) {
+                sscanf(lines[k] + 5, "%" G_GINT64_FORMAT " %" G_GINT64_FORMAT, &base_size, &base_mtime);
+            }
+        }
+        g_strfreev(lines);
+
+        if (body && !owner_alive(pid)) {
+            gsize offset = body + 2 - contents;
+            Document *doc = document_new();
+            gint applied = replay(doc, contents + offset, length - offset, filename, base_size, base_mtime);
+
+            if (applied == 0) {
+                // Nothing got past the header, or only a torn first record: there is nothing to recover
+                g_unlink(path);
+            } else if (applied > 0) {
+                // The tab takes the journal over; rewriting it records the new owner and the replayed text
+                Journal *j = journal_new();
+                DocSnapshot *text = document_snapshot(doc);
+                gchar *pid_line = g_strdup_printf("pid %d\n", pid);
+                gchar *own_pid = g_strdup_printf("pid %d\n", (gint) getpid());
+                gchar *header = g_strndup(contents, offset);
+                gchar **parts = g_strsplit(header, pid_line, 2);
+                j->path = g_strdup(path);
+                j->header = g_strjoinv(own_pid, parts);
+                g_strfreev(parts);
+                g_free(header);
+                g_free(own_pid);
+                g_free(pid_line);
+                start_write(j, doc_snapshot_ref(text));
+                documents_recover(filename, text, j);
+                g_message("Recovered unsaved changes to %s", filename ? filename : "an untitled document");
+            } else {
+                // The file changed since the edits were made; keep them aside rather than replay them wrongly
+                gchar *stale = g_strconcat(path, ".stale", NULL);
+                g_warning("Not recovering %s: %s changed on disk (kept as %s)", name, filename, stale);
+                g_rename(path, stale);
+                g_free(stale);
+            }
+            document_free(doc);
+        }
+        g_free(filename);
+        g_free(contents);
+        g_free(path);
+    }
+    g_ptr_array_free(names, TRUE);
+}
+
+void setup_journal(void) {
+    journal.dir = g_build_filename(g_get_user_data_dir(), "codepad", "journal", NULL);
+    journal.journals = g_ptr_array_new();
+    g_mkdir_with_parents(journal.dir, 0700);
+
+    g_signal_connect_after(editor->buffer, "insert-text", G_CALLBACK(on_journal_insert_text), NULL);
+    g_signal_connect(editor->buffer, "delete-range", G_CALLBACK(on_journal_delete_range), NULL);
+}
@@ -0,0 +1,307 @@
+#include "header.h"
+
+#define LOAD_CHUNK_SIZE (256 * 1024)   // Bytes requested per asynchronous read
+#define LOAD_SLICE_SIZE (64 * 1024)    // Bytes inserted into the buffer per idle dispatch
+#define LOAD_MAX_QUEUED 8              // Chunks read ahead before reading pauses
+
+typedef struct {
+    gchar *filename;
+    GInputStream *stream;
+    GCancellable *cancellable;
+    GQueue chunks;          // Validated GBytes waiting to be inserted
+    gsize chunk_offset;     // Bytes of the head chunk already inserted
+    GByteArray *carry;      // Incomplete UTF-8 sequence at the end of the last chunk
+    goffset total_size;
+    goffset inserted;
+    gboolean pending_io;    // An async open or read is in flight
+    gboolean eof;
+    gboolean finished;
+    gboolean placed_cursor;
+    guint insert_source;
+} FileLoader;
+
+static FileLoader *loader = NULL;
+
+static void request_next_chunk(FileLoader *load);
+
+static void free_loader(FileLoader *load) {
+    g_queue_clear_full(&load->chunks, (GDestroyNotify) g_bytes_unref);
+    g_byte_array_unref(load->carry);
+    g_clear_object(&load->stream);
+    g_object_unref(load->cancellable);
+    g_free(load->filename);
+    g_free(load);
+}
+
+static void show_progress(gboolean visible) {
+    gtk_widget_set_visible(editor->load_progress, visible);
+    gtk_widget_set_visible(editor->load_cancel_button, visible);
+}
+
+static void update_progress(FileLoader *load) {
+    gchar *text;
+    if (load->total_size > 0) {
+        gdouble fraction = (gdouble) load->inserted / load->total_size;
+        gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(editor->load_progress), MIN(fraction, 1.0));
+        text = g_strdup_printf("Loading %d%%", (gint) (MIN(fraction, 1.0) * 100));
+    } else {
+        gtk_progress_bar_pulse(GTK_PROGRESS_BAR(editor->load_progress));
+        text = g_strdup_printf("Loading %" G_GINT64_FORMAT " KB", (gint64) load->inserted / 1024);
+    }
+    gtk_progress_bar_set_text(GTK_PROGRESS_BAR(editor->load_progress), text);
+    g_free(text);
+}
+
+// Ends the load; the loader itself is freed once no async operation still points at it
+static void finish_load(FileLoader *load, GError *error) {
+    gboolean free_now = !load->pending_io;
+
+    if (load->insert_source) {
+        g_source_remove(load->insert_source);
+        load->insert_source = 0;
+    }
+    load->finished = TRUE;
+    if (loader == load) {
+        loader = NULL;
+    }
+
+    // Never leave a partial document around that could be saved over the original. It is dropped
+    // while still loading, so the recovery journal does not record the clearing as an edit.
+    if (error) {
+        gtk_text_buffer_set_text(editor->buffer, "", 0);
+    }
+    editor->loading = FALSE;
+    show_progress(FALSE);
+    undo_end_reload(!error);
+
+    if (!error) {
+        GtkTextIter start;
+        gtk_text_buffer_get_start_iter(editor->buffer, &start);
+        gtk_text_buffer_place_cursor(editor->buffer, &start);
+        g_free(editor->current_file);
+        editor->current_file = g_strdup(load->filename);
+        editor->is_modified = FALSE;
+        editor->unloaded = FALSE;
+        gtk_text_view_set_editable(GTK_TEXT_VIEW(editor->text_view), TRUE);
+        if (editor->pending_goto_line >= 0) {
+            goto_line(editor->pending_goto_line);
+        }
+    } else {
+        // The empty buffer stays read-only and unsaveable until a load of this tab succeeds
+        editor->is_modified = FALSE;
+
+        if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+            GtkWidget *error_dialog = gtk_message_dialog_new(GTK_WINDOW(editor->window),
+                                             GTK_DIALOG_DESTROY_WITH_PARENT,
+                                             GTK_MESSAGE_ERROR,
+                                             GTK_BUTTONS_CLOSE,
+                                             "Error opening file: %s", error->message);
+            gtk_dialog_run(GTK_DIALOG(error_dialog));
+            gtk_widget_destroy(error_dialog);
+        }
+    }
+    editor->pending_goto_line = -1;
+    schedule_refresh(REFRESH_ALL);
+
+    if (free_now) {
+        free_loader(load);
+    }
+}
+
+static gboolean on_insert_idle(gpointer data) {
+    FileLoader *load = data;
+    GBytes *chunk = g_queue_peek_head(&load->chunks);
+
+    if (!chunk) {
+        load->insert_source = 0;
+        if (load->eof) {
+            finish_load(load, NULL);
+        }
+        return G_SOURCE_REMOVE;
+    }
+
+    gsize size;
+    const gchar *bytes = g_bytes_get_data(chunk, &size);
+    const gchar *slice = bytes + load->chunk_offset;
+    gsize len = MIN(size - load->chunk_offset, LOAD_SLICE_SIZE);
+
+    // Never split a UTF-8 sequence between two inserts
+    while (load->chunk_offset + len < size && (slice[len] & 0xC0) == 0x80) {
+        len--;
+    }
+
+    GtkTextIter end;
+    gtk_text_buffer_get_end_iter(editor->buffer, &end);
+    gtk_text_buffer_insert(editor->buffer, &end, slice, len);
+    load->chunk_offset += len;
+    load->inserted += len;
+
+    // Keep the cursor at the top so later slices append below the first screen
+    if (!load->placed_cursor) {
+        GtkTextIter start;
+        gtk_text_buffer_get_start_iter(editor->buffer, &start);
+        gtk_text_buffer_place_cursor(editor->buffer, &start);
+        load->placed_cursor = TRUE;
+    }
+
+    if (load->chunk_offset == size) {
+        g_bytes_unref(g_queue_pop_head(&load->chunks));
+        load->chunk_offset = 0;
+        request_next_chunk(load);
+    }
+    update_progress(load);
+    return G_SOURCE_CONTINUE;
+}
+
+static void queue_chunk(FileLoader *load, GBytes *chunk) {
+    g_queue_push_tail(&load->chunks, chunk);
+    if (!load->insert_source) {
+        // Default idle priority lets redraws and input run between slices
+        load->insert_source = g_idle_add(on_insert_idle, load);
+    }
+}
+
+// Returns the validated part of carry + data and keeps a truncated trailing sequence for the next chunk
+static GBytes *validate_chunk(FileLoader *load, GBytes *data, GError **error) {
+    gsize size;
+    const gchar *bytes = g_bytes_get_data(data, &size);
+
+    g_byte_array_append(load->carry, (const guint8 *) bytes, size);
+    const gchar *text = (const gchar *) load->carry->data;
+    gsize len = load->carry->len;
+    const gchar *valid_end;
+
+    if (!g_utf8_validate_len(text, len, &valid_end)) {
+        gsize remaining = text + len - valid_end;
+        if (remaining >= 4 || g_utf8_get_char_validated(valid_end, remaining) != (gunichar) -2) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                        "The file is not valid UTF-8 text");
+            return NULL;
+        }
+    }
+
+    GBytes *valid = g_bytes_new(text, valid_end - text);
+    g_byte_array_remove_range(load->carry, 0, valid_end - text);
+    return valid;
+}
+
+static void on_chunk_ready(GObject *source, GAsyncResult *result, gpointer data) {
+    FileLoader *load = data;
+    GError *error = NULL;
+    GBytes *bytes = g_input_stream_read_bytes_finish(G_INPUT_STREAM(source), result, &error);
+
+    load->pending_io = FALSE;
+    if (load->finished) {
+        g_clear_error(&error);
+        g_clear_pointer(&bytes, g_bytes_unref);
+        free_loader(load);
+        return;
+    }
+    if (!bytes) {
+        finish_load(load, error);
+        g_error_free(error);
+        return;
+    }
+
+    if (g_bytes_get_size(bytes) == 0) {
+        load->eof = TRUE;
+        if (load->carry->len > 0) {
+            g_set_error(&error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                        "The file is not valid UTF-8 text");
+        }
+    } else {
+        GBytes *valid = validate_chunk(load, bytes, &error);
+        if (valid && g_bytes_get_size(valid) > 0) {
+            queue_chunk(load, valid);
+        } else if (valid) {
+            g_bytes_unref(valid);
+        }
+    }
+    g_bytes_unref(bytes);
+
+    if (error) {
+        finish_load(load, error);
+        g_error_free(error);
+        return;
+    }
+
+    if (load->eof && !load->insert_source) {
+        finish_load(load, NULL);
+        return;
+    }
+    request_next_chunk(load);
+}
+
+static void request_next_chunk(FileLoader *load) {
+    if (load->pending_io || load->eof || load->finished ||
+        g_queue_get_length(&load->chunks) >= LOAD_MAX_QUEUED) {
+        return;
+    }
+    load->pending_io = TRUE;
+    g_input_stream_read_bytes_async(load->stream, LOAD_CHUNK_SIZE, G_PRIORITY_DEFAULT,
+                                    load->cancellable, on_chunk_ready, load);
+}
+
+static void on_file_read_ready(GObject *source, GAsyncResult *result, gpointer data) {
+    FileLoader *load = data;
+    GError *error = NULL;
+    GFileInputStream *stream = g_file_read_finish(G_FILE(source), result, &error);
+
+    load->pending_io = FALSE;
+    if (load->finished) {
+        g_clear_error(&error);
+        g_clear_object(&stream);
+        free_loader(load);
+        return;
+    }
+    if (!stream) {
+        finish_load(load, error);
+        g_error_free(error);
+        return;
+    }
+    load->stream = G_INPUT_STREAM(stream);
+
+    // Querying an open stream is an fstat, cheap enough for the main thread
+    GFileInfo *info = g_file_input_stream_query_info(stream, G_FILE_ATTRIBUTE_STANDARD_SIZE, NULL, NULL);
+    if (info) {
+        load->total_size = g_file_info_get_size(info);
+        g_object_unref(info);
+    }
+    request_next_chunk(load);
+}
+
+void load_file_async(const gchar *filename) {
+    cancel_file_load();
+
+    FileLoader *load = g_new0(FileLoader, 1);
+    load->filename = g_strdup(filename);
+    load->cancellable = g_cancellable_new();
+    load->carry = g_byte_array_new();
+    g_queue_init(&load->chunks);
+    loader = load;
+
+    editor->loading = TRUE;
+    editor->unloaded = TRUE;
+    editor->pending_goto_line = -1;
+    gtk_text_buffer_set_text(editor->buffer, "", 0);
+    gtk_text_view_set_editable(GTK_TEXT_VIEW(editor->text_view), FALSE);
+    gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(editor->load_progress), 0.0);
+    show_progress(TRUE);
+
+    GFile *file = g_file_new_for_path(filename);
+    load->pending_io = TRUE;
+    g_file_read_async(file, G_PRIORITY_DEFAULT, load->cancellable, on_file_read_ready, load);
+    g_object_unref(file);
+}
+
+void cancel_file_load(void) {
+    if (!loader) {
+        return;
+    }
+
+    FileLoader *load = loader;
+    GError *error = g_error_new_literal(G_IO_ERROR, G_IO_ERROR_CANCELLED, "Loading cancelled");
+    g_cancellable_cancel(load->cancellable);
+    finish_load(load, error);
+    g_error_free(error);
+}
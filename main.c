@@ -3,7 +3,19 @@
 CodeEditor *editor = NULL;
 
 int main(int argc, char *argv[]) {
-    gtk_init(&argc, &argv);
+    gint64 started = g_get_monotonic_time();
+    const gchar *profile_output = NULL;
+
+    // --startup-profile[=FILE] times each startup phase, writes a Chrome trace and exits after the first frame
+    for (gint i = 1; i < argc; i++) {
+        if (g_strcmp0(argv[i], "--startup-profile") == 0) {
+            profile_output = "codepad-startup-trace.json";
+        } else if (g_str_has_prefix(argv[i], "--startup-profile=")) {
+            profile_output = argv[i] + strlen("--startup-profile=");
+        }
+    }
+    trace_init(started, profile_output);
+    TRACE_PHASE("gtk_init", gtk_init(&argc, &argv));
 
     // Initialize editor structure
     editor = g_new0(CodeEditor, 1);
@@ -11,23 +23,73 @@ int main(int argc, char *argv[]) {
     editor->zoom_level = 12;
     editor->is_modified = FALSE;
     editor->current_file = NULL;
+    editor->pending_goto_line = -1;
+
+    // Files at least this large open in the memory-mapped viewer
+    const gchar *threshold_mb = g_getenv("CODEPAD_LARGE_FILE_MB");
+    editor->large_file_threshold = (threshold_mb ? g_ascii_strtoull(threshold_mb, NULL, 10) : 256) * 1024 * 1024;
+
+    // Memory for hidden tabs before clean ones are dropped and re-read on demand
+    const gchar *budget_mb = g_getenv("CODEPAD_TAB_BUDGET_MB");
+    editor->document_budget = (budget_mb ? g_ascii_strtoull(budget_mb, NULL, 10) : 256) * 1024 * 1024;
+
+    // Undo history kept across all tabs before the oldest actions are dropped
+    const gchar *undo_mb = g_getenv("CODEPAD_UNDO_BUDGET_MB");
+    editor->undo_budget = (undo_mb ? g_ascii_strtoull(undo_mb, NULL, 10) : 64) * 1024 * 1024;
+
+    // The shell normally starts the first time the terminal is shown
+    editor->prewarm_terminal = g_strcmp0(g_getenv("CODEPAD_PREWARM_TERMINAL"), "1") == 0;
 
     // Setup components
-    setup_ui();
-    setup_editor();
-    setup_terminal();
-    setup_callbacks();
+    TRACE_PHASE("setup_ui", setup_ui());
+    TRACE_PHASE("setup_theme", setup_theme());
+    TRACE_PHASE("setup_editor", setup_editor());
+    TRACE_PHASE("setup_journal", setup_journal());
+    TRACE_PHASE("setup_documents", setup_documents());
+    TRACE_PHASE("setup_highlight", setup_highlight());
+    TRACE_PHASE("setup_viewer", setup_viewer());
+    TRACE_PHASE("setup_search", setup_search());
+    TRACE_PHASE("setup_find_files", setup_find_files());
+    TRACE_PHASE("setup_terminal", setup_terminal());
+    TRACE_PHASE("setup_perf", setup_perf());
+    TRACE_PHASE("setup_callbacks", setup_callbacks());
 
     // Apply initial theme
-    apply_theme();
-    update_status_bar();
-    update_line_numbers();
+    TRACE_PHASE("apply_theme", apply_theme());
+    schedule_refresh(REFRESH_STATUS | REFRESH_GUTTER);
+
+    // Previous tabs come back unread, except the active one which streams in behind the first frame
+    TRACE_PHASE("session_restore", session_restore(started));
+
+    // Unsaved edits from a run that crashed come back as modified tabs
+    TRACE_PHASE("journal_recover", journal_recover());
 
     // Show window
-    gtk_widget_show_all(editor->window);
+    trace_watch_first_paint(editor->text_view);
+    TRACE_PHASE("show_all", gtk_widget_show_all(editor->window));
     gtk_widget_hide(editor->terminal_container);
 
     gtk_main();
+    session_close();
+
+    // Unsaved edits were confirmed away on the way out; a profiling run leaves recovered ones for next time
+    if (!profile_output) {
+        journal_shutdown();
+    }
+
+    // Latency histograms for the performance dashboards
+    const gchar *perf_output = g_getenv("CODEPAD_PERF_JSON");
+    GError *error = NULL;
+    if (perf_output && !perf_dump_json(perf_output, &error)) {
+        g_warning("Could not write %s: %s", perf_output, error->message);
+        g_error_free(error);
+    }
+
+    g_debug("Coalesced %" G_GUINT64_FORMAT " UI refreshes", refresh_coalesced_count());
+    g_debug("%u style providers attached at exit", theme_provider_count());
+    g_debug("Lexed %" G_GUINT64_FORMAT " lines, longest highlight slice %" G_GINT64_FORMAT " us",
+            highlight_lines_lexed(), highlight_longest_slice());
+    g_debug("Undo history holds %" G_GSIZE_FORMAT " bytes", undo_memory_used());
 
     // Cleanup
     if (editor->current_file) {
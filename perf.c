@@ -0,0 +1,233 @@
+#include "header.h"
+
+#define PERF_SUB_BUCKETS 8                      // Buckets per power of two, so about 9% resolution
+#define PERF_BUCKETS (34 * PERF_SUB_BUCKETS)    // Up to 2^34 us, far past anything worth measuring
+#define PERF_MAX_INPUT_LATENCY (500 * 1000)     // A key that caused no frame within this is not a sample
+#define PERF_OVERLAY_INTERVAL 500               // Overlay refresh in milliseconds
+
+typedef struct {
+    guint64 count;
+    gint64 total;
+    gint64 max;
+    guint32 buckets[PERF_BUCKETS];
+} PerfHistogram;
+
+static const gchar *metric_names[PERF_N_METRICS] = {
+    "key-to-paint", "frame", "text-changed", "mark-set", "search-changed",
+    "refresh-title", "refresh-status", "refresh-gutter", "refresh-highlight", "refresh-search", "refresh-font",
+    "apply-theme", "gutter-draw"
+};
+
+static struct {
+    PerfHistogram histograms[PERF_N_METRICS];
+    gint64 key_received;        // Monotonic time of the last non-modifier key press
+    gint64 pending_input;       // Monotonic time of the oldest key press not yet on screen, or 0
+    GtkWidget *overlay_label;
+    guint overlay_source;
+} perf;
+
+// Log-linear bucket: the power of two, then the next three bits below the leading one
+static guint bucket_index(gint64 us) {
+    if (us <= 0) {
+        return 0;
+    }
+    guint msb = g_bit_storage((gulong) us) - 1;
+    guint sub = (guint) ((((guint64) us << 3) >> msb) & (PERF_SUB_BUCKETS - 1));
+    return MIN(msb * PERF_SUB_BUCKETS + sub, PERF_BUCKETS - 1);
+}
+
+static gint64 bucket_upper(guint index) {
+    guint msb = index / PERF_SUB_BUCKETS;
+    guint sub = index % PERF_SUB_BUCKETS;
+    return (gint64) ((((guint64) PERF_SUB_BUCKETS + sub + 1) << msb) >> 3);
+}
+
+void perf_record(PerfMetric metric, gint64 us) {
+    PerfHistogram *histogram = &perf.histograms[metric];
+
+    histogram->count++;
+    histogram->total += us;
+    histogram->max = MAX(histogram->max, us);
+    histogram->buckets[bucket_index(us)]++;
+}
+
+gint64 perf_begin(void) {
+    return g_get_monotonic_time();
+}
+
+void perf_end(PerfMetric metric, gint64 start) {
+    perf_record(metric, g_get_monotonic_time() - start);
+}
+
+// Upper bound of the bucket holding the q-th quantile, or 0 without samples
+static gint64 percentile(PerfHistogram *histogram, gdouble q) {
+    guint64 rank = (guint64) (q * histogram->count + 0.5);
+    guint64 seen = 0;
+
+    if (histogram->count == 0) {
+        return 0;
+    }
+    for (guint i = 0; i < PERF_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+        if (seen >= MAX(rank, 1)) {
+            return MIN(bucket_upper(i), histogram->max);
+        }
+    }
+    return histogram->max;
+}
+
+// Seen before any handler acts on the key; only a change to the text or cursor makes it a sample
+static gboolean on_perf_key_press(GtkWidget *widget, GdkEventKey *event, gpointer data) {
+    if (!event->is_modifier) {
+        perf.key_received = g_get_monotonic_time();
+    }
+    return FALSE;
+}
+
+// Opens a sample when the change is being made by the key press being handled
+static void arm_key_sample(void) {
+    GdkEvent *event;
+
+    if (perf.pending_input || !perf.key_received || !(event = gtk_get_current_event())) {
+        return;
+    }
+    if (event->type == GDK_KEY_PRESS && !event->key.is_modifier) {
+        perf.pending_input = perf.key_received;
+    }
+    gdk_event_free(event);
+}
+
+static void on_perf_insert_text(GtkTextBuffer *buffer, GtkTextIter *location, gchar *text, gint len, gpointer data) {
+    arm_key_sample();
+}
+
+static void on_perf_delete_range(GtkTextBuffer *buffer, GtkTextIter *start, GtkTextIter *end, gpointer data) {
+    arm_key_sample();
+}
+
+static void on_perf_mark_set(GtkTextBuffer *buffer, GtkTextIter *location, GtkTextMark *mark, gpointer data) {
+    if (mark == gtk_text_buffer_get_insert(buffer)) {
+        arm_key_sample();
+    }
+}
+
+// Frame time is measured from the frame clock's start of frame to the end of painting
+static void on_perf_after_paint(GdkFrameClock *clock, gpointer data) {
+    gint64 now = g_get_monotonic_time();
+
+    perf_record(PERF_FRAME, now - gdk_frame_clock_get_frame_time(clock));
+    if (perf.pending_input) {
+        if (now - perf.pending_input < PERF_MAX_INPUT_LATENCY) {
+            perf_record(PERF_KEY_TO_PAINT, now - perf.pending_input);
+        }
+        perf.pending_input = 0;
+    }
+}
+
+static void on_perf_window_realize(GtkWidget *widget, gpointer data) {
+    g_signal_connect(gtk_widget_get_frame_clock(widget), "after-paint", G_CALLBACK(on_perf_after_paint), NULL);
+}
+
+static gchar *format_ms(gint64 us) {
+    return g_strdup_printf("%.2f", us / 1000.0);
+}
+
+static gint compare_by_p99(gconstpointer a, gconstpointer b) {
+    gint64 pa = percentile(&perf.histograms[*(const gint *) a], 0.99);
+    gint64 pb = percentile(&perf.histograms[*(const gint *) b], 0.99);
+    return pa < pb ? 1 : pa > pb ? -1 : 0;
+}
+
+static gboolean update_overlay(gpointer data) {
+    PerfHistogram *keys = &perf.histograms[PERF_KEY_TO_PAINT];
+    PerfHistogram *frames = &perf.histograms[PERF_FRAME];
+    GString *text = g_string_new(NULL);
+    gint handlers[PERF_N_METRICS];
+    gint n_handlers = 0;
+
+    g_string_append_printf(text, "key→paint  p50 %.2f  p99 %.2f ms  (%" G_GUINT64_FORMAT ")\n",
+                           percentile(keys, 0.5) / 1000.0, percentile(keys, 0.99) / 1000.0, keys->count);
+    g_string_append_printf(text, "frame      p50 %.2f  p99 %.2f ms  (%" G_GUINT64_FORMAT ")\n",
+                           percentile(frames, 0.5) / 1000.0, percentile(frames, 0.99) / 1000.0, frames->count);
+
+    for (gint metric = PERF_TEXT_CHANGED; metric < PERF_N_METRICS; metric++) {
+        if (perf.histograms[metric].count > 0) {
+            handlers[n_handlers++] = metric;
+        }
+    }
+    qsort(handlers, n_handlers, sizeof(gint), compare_by_p99);
+    g_string_append(text, "slowest handlers (p99 / max ms):");
+    for (gint i = 0; i < MIN(n_handlers, 4); i++) {
+        PerfHistogram *histogram = &perf.histograms[handlers[i]];
+        gchar *p99 = format_ms(percentile(histogram, 0.99));
+        gchar *max = format_ms(histogram->max);
+        g_string_append_printf(text, "\n  %-18s %s / %s", metric_names[handlers[i]], p99, max);
+        g_free(p99);
+        g_free(max);
+    }
+
+    gtk_label_set_text(GTK_LABEL(perf.overlay_label), text->str);
+    g_string_free(text, TRUE);
+    return G_SOURCE_CONTINUE;
+}
+
+void toggle_perf_overlay(void) {
+    if (perf.overlay_source) {
+        g_source_remove(perf.overlay_source);
+        perf.overlay_source = 0;
+        gtk_widget_hide(perf.overlay_label);
+        return;
+    }
+    update_overlay(NULL);
+    gtk_widget_show(perf.overlay_label);
+    perf.overlay_source = g_timeout_add(PERF_OVERLAY_INTERVAL, update_overlay, NULL);
+}
+
+// Histograms as JSON for the dashboards; bucket pairs are [upper bound in us, count]
+gboolean perf_dump_json(const gchar *path, GError **error) {
+    GString *json = g_string_new("{\"metrics\":[\n");
+
+    for (gint metric = 0; metric < PERF_N_METRICS; metric++) {
+        PerfHistogram *histogram = &perf.histograms[metric];
+        gboolean first = TRUE;
+
+        g_string_append_printf(json, "{\"name\":\"%s\",\"count\":%" G_GUINT64_FORMAT ",\"mean_us\":%" G_GINT64_FORMAT
+                               ",\"p50_us\":%" G_GINT64_FORMAT ",\"p99_us\":%" G_GINT64_FORMAT
+                               ",\"max_us\":%" G_GINT64_FORMAT ",\"buckets\":[",
+                               metric_names[metric], histogram->count,
+                               histogram->count ? histogram->total / (gint64) histogram->count : 0,
+                               percentile(histogram, 0.5), percentile(histogram, 0.99), histogram->max);
+        for (guint i = 0; i < PERF_BUCKETS; i++) {
+            if (histogram->buckets[i]) {
+                g_string_append_printf(json, "%s[%" G_GINT64_FORMAT ",%u]", first ? "" : ",",
+                                       bucket_upper(i), histogram->buckets[i]);
+                first = FALSE;
+            }
+        }
+        g_string_append(json, metric + 1 < PERF_N_METRICS ? "]},\n" : "]}\n");
+    }
+    g_string_append(json, "]}\n");
+
+    gboolean written = g_file_set_contents(path, json->str, json->len, error);
+    g_string_free(json, TRUE);
+    return written;
+}
+
+void setup_perf(void) {
+    // Top-right corner of the editor, above the text
+    perf.overlay_label = gtk_label_new(NULL);
+    gtk_style_context_add_class(gtk_widget_get_style_context(perf.overlay_label), "perf-overlay");
+    gtk_widget_set_halign(perf.overlay_label, GTK_ALIGN_END);
+    gtk_widget_set_valign(perf.overlay_label, GTK_ALIGN_START);
+    gtk_widget_set_margin_end(perf.overlay_label, 24);
+    gtk_widget_set_margin_top(perf.overlay_label, 8);
+    gtk_widget_set_no_show_all(perf.overlay_label, TRUE);
+    gtk_overlay_add_overlay(GTK_OVERLAY(editor->overlay), perf.overlay_label);
+
+    // A key press that edits or moves the cursor opens a sample; the paint that follows closes it
+    g_signal_connect(editor->window, "key-press-event", G_CALLBACK(on_perf_key_press), NULL);
+    g_signal_connect(editor->buffer, "insert-text", G_CALLBACK(on_perf_insert_text), NULL);
+    g_signal_connect(editor->buffer, "delete-range", G_CALLBACK(on_perf_delete_range), NULL);
+    g_signal_connect(editor->buffer, "mark-set", G_CALLBACK(on_perf_mark_set), NULL);
+    g_signal_connect(editor->window, "realize", G_CALLBACK(on_perf_window_realize), NULL);
+}
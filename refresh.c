@@ -0,0 +1,61 @@
+#include "header.h"
+
+// Consumers waiting for the next refresh and counters for the coalescing stats
+static guint pending_flags = 0;
+static guint refresh_source = 0;
+static guint64 refresh_requests = 0;
+static guint64 refresh_runs = 0;
+
+static gboolean on_refresh_idle(gpointer data) {
+    flush_refresh();
+    return G_SOURCE_REMOVE;
+}
+
+void schedule_refresh(guint flags) {
+    pending_flags |= flags;
+    refresh_requests++;
+
+    // Runs just ahead of the redraw idle, so at most one refresh happens per frame
+    if (!refresh_source) {
+        refresh_source = g_idle_add_full(GDK_PRIORITY_REDRAW - 5, on_refresh_idle, NULL, NULL);
+    }
+}
+
+void flush_refresh(void) {
+    guint flags = pending_flags;
+    gint64 trace_start = trace_begin();
+
+    if (refresh_source) {
+        g_source_remove(refresh_source);
+        refresh_source = 0;
+    }
+    if (!flags) {
+        return;
+    }
+    pending_flags = 0;
+    refresh_runs++;
+
+    if (flags & REFRESH_FONT) {
+        PERF_TIME(PERF_REFRESH_FONT, update_font());
+    }
+    if (flags & REFRESH_TITLE) {
+        PERF_TIME(PERF_REFRESH_TITLE, update_window_title(); documents_update_label());
+    }
+    if (flags & REFRESH_STATUS) {
+        PERF_TIME(PERF_REFRESH_STATUS, update_status_bar());
+    }
+    if (flags & REFRESH_GUTTER) {
+        PERF_TIME(PERF_REFRESH_GUTTER, update_line_numbers());
+    }
+    if (flags & REFRESH_HIGHLIGHT) {
+        PERF_TIME(PERF_REFRESH_HIGHLIGHT, highlight_update());
+    }
+    if (flags & REFRESH_SEARCH) {
+        PERF_TIME(PERF_REFRESH_SEARCH, search_update_highlight());
+    }
+    trace_end("refresh", trace_start);
+}
+
+guint64 refresh_coalesced_count(void) {
+    return refresh_requests - refresh_runs;
+}
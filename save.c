@@ -0,0 +1,200 @@
+#include "header.h"
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#ifdef G_OS_WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+typedef struct {
+    gchar *filename;
+    DocSnapshot *snapshot;
+    guint64 change_seq;     // editor->change_seq when the snapshot was taken
+    gboolean close_after;
+} SaveJob;
+
+static gboolean saving = FALSE;
+static GQueue pending = G_QUEUE_INIT;      // SaveJobs requested while a write was in flight, oldest first
+
+static void free_job(gpointer data) {
+    SaveJob *job = data;
+    g_free(job->filename);
+    doc_snapshot_unref(job->snapshot);
+    g_free(job);
+}
+
+static gboolean write_all(gint fd, const gchar *data, gsize length) {
+    while (length > 0) {
+        gssize written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return FALSE;
+        }
+        data += written;
+        length -= written;
+    }
+    return TRUE;
+}
+
+// Writes next to the target, flushes to disk and renames over it, so a crash leaves either version intact
+static gboolean write_snapshot(gint fd, DocSnapshot *snapshot) {
+    guint n_pieces = doc_snapshot_get_n_pieces(snapshot);
+    for (guint i = 0; i < n_pieces; i++) {
+        gsize length;
+        const gchar *data = doc_snapshot_get_piece(snapshot, i, &length);
+        if (!write_all(fd, data, length)) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static gboolean write_atomically(const gchar *filename, DocSnapshot *snapshot, GError **error) {
+    GStatBuf st;
+    gint mode = g_stat(filename, &st) == 0 ? (st.st_mode & 0777) : 0644;
+    gchar *dir = g_path_get_dirname(filename);
+    gchar *base = g_path_get_basename(filename);
+    gchar *tmp_name = g_strdup_printf("%s%c.%s.XXXXXX", dir, G_DIR_SEPARATOR, base);
+    gboolean ok = FALSE;
+
+    gint fd = g_mkstemp_full(tmp_name, O_WRONLY | O_BINARY, mode);
+    if (fd < 0) {
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno),
+                    "Could not create a temporary file in %s: %s", dir, g_strerror(errno));
+        goto out;
+    }
+
+    if (!write_snapshot(fd, snapshot) || g_fsync(fd) != 0) {
+        gint saved_errno = errno;
+        g_close(fd, NULL);
+        g_unlink(tmp_name);
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno),
+                    "Could not write %s: %s", filename, g_strerror(saved_errno));
+        goto out;
+    }
+    if (!g_close(fd, error)) {
+        g_unlink(tmp_name);
+        goto out;
+    }
+
+    if (g_rename(tmp_name, filename) != 0) {
+        gint saved_errno = errno;
+        g_unlink(tmp_name);
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno),
+                    "Could not replace %s: %s", filename, g_strerror(saved_errno));
+        goto out;
+    }
+    ok = TRUE;
+
+out:
+    g_free(tmp_name);
+    g_free(base);
+    g_free(dir);
+    return ok;
+}
+
+static void save_thread(GTask *task, gpointer source, gpointer task_data, GCancellable *cancellable) {
+    SaveJob *job = task_data;
+    GError *error = NULL;
+
+    if (write_atomically(job->filename, job->snapshot, &error)) {
+        g_task_return_boolean(task, TRUE);
+    } else {
+        g_task_return_error(task, error);
+    }
+}
+
+static void on_save_done(GObject *source, GAsyncResult *result, gpointer data);
+
+static void start_job(SaveJob *job) {
+    saving = TRUE;
+    schedule_refresh(REFRESH_STATUS);
+
+    GTask *task = g_task_new(NULL, NULL, on_save_done, NULL);
+    g_task_set_task_data(task, job, free_job);
+    g_task_run_in_thread(task, save_thread);
+    g_object_unref(task);
+}
+
+static void on_save_done(GObject *source, GAsyncResult *result, gpointer data) {
+    SaveJob *job = g_task_get_task_data(G_TASK(result));
+    GError *error = NULL;
+
+    saving = FALSE;
+    if (g_task_propagate_boolean(G_TASK(result), &error)) {
+        // Edits made while the write was in flight keep the document dirty
+        if (editor->change_seq == job->change_seq && g_strcmp0(editor->current_file, job->filename) == 0) {
+            editor->is_modified = FALSE;
+            journal_discard(journal_get_active());
+        } else {
+            documents_saved(job->filename, job->change_seq);
+        }
+        schedule_refresh(REFRESH_TITLE | REFRESH_STATUS);
+
+        if (job->close_after && !editor->is_modified) {
+            gtk_main_quit();
+            return;
+        }
+        // Typed into while saving before quitting: write the newer text, then quit
+        if (job->close_after && g_strcmp0(editor->current_file, job->filename) == 0) {
+            save_file_async(editor->current_file, TRUE);
+        }
+    } else {
+        schedule_refresh(REFRESH_STATUS);
+
+        // The user has to see the failure, so nothing queued may quit the editor afterwards
+        for (GList *link = pending.head; link; link = link->next) {
+            ((SaveJob *) link->data)->close_after = FALSE;
+        }
+        GtkWidget *error_dialog = gtk_message_dialog_new(GTK_WINDOW(editor->window),
+                                         GTK_DIALOG_DESTROY_WITH_PARENT,
+                                         GTK_MESSAGE_ERROR,
+                                         GTK_BUTTONS_CLOSE,
+                                         "Error saving file: %s", error->message);
+        gtk_dialog_run(GTK_DIALOG(error_dialog));
+        gtk_widget_destroy(error_dialog);
+        g_error_free(error);
+    }
+
+    if (!saving && !g_queue_is_empty(&pending)) {
+        start_job(g_queue_pop_head(&pending));
+    }
+}
+
+void save_file_async(const gchar *filename, gboolean close_after) {
+    SaveJob *job = g_new0(SaveJob, 1);
+    job->filename = g_strdup(filename);
+    job->snapshot = document_snapshot(editor->document);
+    job->change_seq = editor->change_seq;
+    job->close_after = close_after;
+
+    if (!saving) {
+        start_job(job);
+        return;
+    }
+
+    // One write at a time. Each request keeps its own file and text, so saving another tab or to a
+    // new name while a write is in flight still happens; a newer request for the same file replaces the older.
+    for (GList *link = pending.head; link; link = link->next) {
+        SaveJob *queued = link->data;
+        if (g_strcmp0(queued->filename, filename) == 0) {
+            job->close_after |= queued->close_after;
+            free_job(queued);
+            link->data = job;
+            return;
+        }
+    }
+    g_queue_push_tail(&pending, job);
+}
+
+gboolean save_in_progress(void) {
+    return saving;
+}
@@ -0,0 +1,712 @@
+#include "header.h"
+
+#define SEARCH_CANCEL_CHECK 4096       // Matches between cancellation checks
+#define SEARCH_MAX_HIGHLIGHTS 2000     // Upper bound on tags applied per visible region
+#define SEARCH_RESCAN_DELAY 250        // ms after an edit before results are recomputed
+#define SEARCH_REGEX_CACHE 16          // Compiled patterns kept across keystrokes
+#define SEARCH_REGEX_WINDOW (1024 * 1024) // Bytes matched between cancellation checks
+
+typedef struct {
+    gsize byte;
+    gsize chr;
+    gsize chars;            // Length of the match in characters
+} SearchMatch;
+
+typedef struct {
+    gsize chr;
+    gsize chars;
+    gchar *text;
+} SearchReplacement;
+
+typedef struct {
+    DocSnapshot *snapshot;
+    gchar *query;
+    GRegex *regex;          // Set for regex searches and regex replaces
+    gchar *replacement;     // Replace job when non-NULL
+    guint64 change_seq;
+    GArray *candidates;     // Matches of a prefix of query to narrow, or NULL for a full scan
+    gboolean match_case;
+    gboolean jump;          // Select the match nearest the cursor when done
+} SearchJob;
+
+typedef struct {
+    gchar *pattern;
+    GRegexCompileFlags flags;
+    GRegex *regex;
+} CachedRegex;
+
+static struct {
+    gchar *query;               // Query the results (or the running job) belong to
+    gboolean match_case;
+    gboolean use_regex;
+    gboolean invalid_pattern;
+    GArray *matches;            // SearchMatch in document order, NULL while searching
+    DocSnapshot *snapshot;      // Document version the matches refer to
+    guint64 change_seq;
+    GCancellable *cancellable;
+    gint current;               // Index of the selected match, or -1
+    GtkTextTag *tag;
+    GtkTextMark *highlight_start;
+    GtkTextMark *highlight_end;
+    guint rescan_source;
+    GCancellable *replace_cancellable;
+    GQueue regex_cache;         // CachedRegex, most recently used first; main thread only
+} search;
+
+// Compiled patterns are cached so retyping, toggling and rescans after edits skip compilation.
+// extra_flags is G_REGEX_RAW for the viewer, whose mapped files need not be valid UTF-8.
+GRegex *search_compile_regex(const gchar *pattern, gboolean match_case, GRegexCompileFlags extra_flags, GError **error) {
+    // G_REGEX_OPTIMIZE turns on the PCRE JIT
+    GRegexCompileFlags flags = G_REGEX_OPTIMIZE | G_REGEX_MULTILINE | (match_case ? 0 : G_REGEX_CASELESS) | extra_flags;
+
+    for (GList *link = search.regex_cache.head; link; link = link->next) {
+        CachedRegex *cached = link->data;
+        if (cached->flags == flags && strcmp(cached->pattern, pattern) == 0) {
+            g_queue_unlink(&search.regex_cache, link);
+            g_queue_push_head_link(&search.regex_cache, link);
+            return g_regex_ref(cached->regex);
+        }
+    }
+
+    GRegex *regex = g_regex_new(pattern, flags, 0, error);
+    if (!regex) {
+        return NULL;
+    }
+
+    CachedRegex *cached = g_new0(CachedRegex, 1);
+    cached->pattern = g_strdup(pattern);
+    cached->flags = flags;
+    cached->regex = regex;
+    g_queue_push_head(&search.regex_cache, cached);
+    if (search.regex_cache.length > SEARCH_REGEX_CACHE) {
+        cached = g_queue_pop_tail(&search.regex_cache);
+        g_regex_unref(cached->regex);
+        g_free(cached->pattern);
+        g_free(cached);
+    }
+    return g_regex_ref(regex);
+}
+
+static void free_job(gpointer data) {
+    SearchJob *job = data;
+    if (job->snapshot) {
+        doc_snapshot_unref(job->snapshot);
+    }
+    g_free(job->query);
+    g_free(job->replacement);
+    if (job->regex) {
+        g_regex_unref(job->regex);
+    }
+    if (job->candidates) {
+        g_array_unref(job->candidates);
+    }
+    g_free(job);
+}
+
+// Literal matches read piece by piece. A match across a piece boundary is found in a seam made of
+// the query length - 1 bytes before the boundary and as many after it.
+static GArray *scan_snapshot(SearchJob *job, gboolean overlapping, GCancellable *cancellable) {
+    GArray *matches = g_array_new(FALSE, FALSE, sizeof(SearchMatch));
+    gsize query_len = strlen(job->query);
+    gsize query_chars = g_utf8_strlen(job->query, -1);
+    gsize overlap = query_len - 1;
+    gchar *seam = g_malloc(2 * overlap + 1);
+    gsize tail = 0;                 // Bytes from before the current piece at the start of seam
+    gsize piece_byte = 0, piece_chr = 0;
+    gsize next_byte = 0;            // Without overlap, where the next match may start
+    guint n_pieces = doc_snapshot_get_n_pieces(job->snapshot);
+
+    for (guint i = 0; i < n_pieces && !g_cancellable_is_cancelled(cancellable); i++) {
+        gsize length;
+        const gchar *text = doc_snapshot_get_piece(job->snapshot, i, &length);
+        const gchar *end = text + length;
+        gsize head = MIN(overlap, length);
+        const gchar *p = seam;
+
+        // Only matches that start before the boundary and end after it; the rest are found within a piece
+        memcpy(seam + tail, text, head);
+        while (tail > 0 && (p = search_find(p, seam + tail + head - p, job->query, query_len, job->match_case)) &&
+               (gsize) (p - seam) < tail) {
+            gsize before = seam + tail - p;
+            if (before < query_len && piece_byte - before >= next_byte) {
+                SearchMatch match = { piece_byte - before, piece_chr - g_utf8_strlen(p, before), query_chars };
+                g_array_append_val(matches, match);
+                next_byte = overlapping ? 0 : match.byte + query_len;
+            }
+            p++;
+        }
+
+        // Overlapping for searches, so that any longer query's matches are a subset of these
+        const gchar *counted = text;
+        gsize chars = piece_chr;
+        p = text + MIN(next_byte > piece_byte ? next_byte - piece_byte : 0, length);
+        while ((p = search_find(p, end - p, job->query, query_len, job->match_case)) != NULL) {
+            chars += g_utf8_strlen(counted, p - counted);
+            counted = p;
+            SearchMatch match = { piece_byte + (p - text), chars, query_chars };
+            g_array_append_val(matches, match);
+            if (matches->len % SEARCH_CANCEL_CHECK == 0 && g_cancellable_is_cancelled(cancellable)) {
+                break;
+            }
+            p += overlapping ? 1 : query_len;
+        }
+        if (!overlapping && matches->len > 0) {
+            next_byte = g_array_index(matches, SearchMatch, matches->len - 1).byte + query_len;
+        }
+
+        // The last query length - 1 bytes seen become the start of the next seam
+        if (length >= overlap) {
+            memcpy(seam, end - overlap, overlap);
+            tail = overlap;
+        } else {
+            gsize keep = MIN(tail, overlap - length);
+            memmove(seam, seam + tail - keep, keep);
+            memcpy(seam + keep, text, length);
+            tail = keep + length;
+        }
+        piece_byte += length;
+        piece_chr = chars + g_utf8_strlen(counted, end - counted);
+    }
+    g_free(seam);
+    return matches;
+}
+
+// Regex matching needs contiguous text: a single-piece snapshot is used in place, others are flattened
+static const gchar *snapshot_text(DocSnapshot *snapshot, gsize *length, gchar **copy) {
+    *copy = NULL;
+    if (doc_snapshot_get_n_pieces(snapshot) == 1) {
+        return doc_snapshot_get_piece(snapshot, 0, length);
+    }
+    *copy = doc_snapshot_flatten(snapshot, length);
+    return *copy;
+}
+
+// End of the window that starts at position: a line break past SEARCH_REGEX_WINDOW bytes, or a
+// character boundary when the line is longer than another whole window
+static gsize regex_window_end(const gchar *text, gsize length, gsize position) {
+    if (length - position <= SEARCH_REGEX_WINDOW) {
+        return length;
+    }
+    const gchar *end = text + position + SEARCH_REGEX_WINDOW;
+    const gchar *newline = memchr(end, '\n', MIN(SEARCH_REGEX_WINDOW, (gsize) (text + length - end)));
+    if (newline) {
+        return newline + 1 - text;
+    }
+    while ((*end & 0xC0) == 0x80) {
+        end++;
+    }
+    return end - text;
+}
+
+typedef struct {
+    SearchJob *job;
+    const gchar *text;
+    const gchar *counted;   // Chars before here are counted in chars
+    gsize chars;
+    GArray *results;
+} RegexScan;
+
+typedef void (*RegexMatchFunc)(RegexScan *scan, GMatchInfo *info);
+
+// Char offset of the match in info, counting on from the previous match
+static gsize regex_match_chr(RegexScan *scan, GMatchInfo *info, gint *start, gint *end) {
+    g_match_info_fetch_pos(info, 0, start, end);
+    scan->chars += g_utf8_strlen(scan->counted, scan->text + *start - scan->counted);
+    scan->counted = scan->text + *start;
+    return scan->chars;
+}
+
+// Calls func for each match of the whole text, in order. Matching runs over windows of the text with a
+// cancellation check between them, so a slow pattern cannot hold the worker for the whole document.
+// The subject always starts at the beginning of the text, so lookbehinds see across windows; a match
+// cut by the end of its window shows up as a partial match and is completed over the rest of the text.
+static void match_regex(RegexScan *scan, gsize length, GCancellable *cancellable, RegexMatchFunc func) {
+    GRegex *regex = scan->job->regex;
+    const gchar *text = scan->text;
+    gsize position = 0;
+
+    while (position < length && !g_cancellable_is_cancelled(cancellable)) {
+        gsize window_end = regex_window_end(text, length, position);
+        GMatchInfo *info = NULL;
+        gint start, end;
+
+        g_regex_match_full(regex, text, window_end, position, G_REGEX_MATCH_PARTIAL_HARD, &info, NULL);
+        position = window_end;
+        while (g_match_info_matches(info) && !g_cancellable_is_cancelled(cancellable)) {
+            func(scan, info);
+            g_match_info_next(info, NULL);
+        }
+        if (g_match_info_is_partial_match(info) && g_match_info_fetch_pos(info, 0, &start, &end)) {
+            g_match_info_free(info);
+            info = NULL;
+            if (g_regex_match_full(regex, text, length, start, G_REGEX_MATCH_ANCHORED, &info, NULL) &&
+                g_match_info_fetch_pos(info, 0, NULL, &end) && end > start) {
+                func(scan, info);
+                position = end;
+            } else {
+                if (g_match_info_matches(info)) {
+                    func(scan, info);
+                }
+                position = g_utf8_next_char(text + start) - text;
+            }
+        }
+        g_match_info_free(info);
+    }
+}
+
+static void add_regex_match(RegexScan *scan, GMatchInfo *info) {
+    gint start, end;
+    gsize chr = regex_match_chr(scan, info, &start, &end);
+    if (end > start) {
+        SearchMatch match = { start, chr, g_utf8_strlen(scan->text + start, end - start) };
+        g_array_append_val(scan->results, match);
+    }
+}
+
+static GArray *scan_regex(SearchJob *job, GCancellable *cancellable) {
+    gsize length;
+    gchar *copy;
+    RegexScan scan = { job, NULL, NULL, 0, g_array_new(FALSE, FALSE, sizeof(SearchMatch)) };
+
+    scan.text = scan.counted = snapshot_text(job->snapshot, &length, &copy);
+    match_regex(&scan, length, cancellable, add_regex_match);
+    g_free(copy);
+    return scan.results;
+}
+
+static void free_replacement(gpointer data) {
+    g_free(((SearchReplacement *) data)->text);
+}
+
+static GArray *new_replacements(void) {
+    GArray *replacements = g_array_new(FALSE, FALSE, sizeof(SearchReplacement));
+    g_array_set_clear_func(replacements, free_replacement);
+    return replacements;
+}
+
+// Literal replaces use the same kernel, and so the same ASCII-only case folding, as the highlighted matches
+static GArray *collect_literal_replacements(SearchJob *job, GCancellable *cancellable) {
+    GArray *matches = scan_snapshot(job, FALSE, cancellable);
+    GArray *replacements = new_replacements();
+
+    for (guint i = 0; i < matches->len; i++) {
+        SearchMatch *match = &g_array_index(matches, SearchMatch, i);
+        SearchReplacement replacement = { match->chr, match->chars, g_strdup(job->replacement) };
+        g_array_append_val(replacements, replacement);
+    }
+    g_array_unref(matches);
+    return replacements;
+}
+
+static void add_regex_replacement(RegexScan *scan, GMatchInfo *info) {
+    gint start, end;
+    gsize chr = regex_match_chr(scan, info, &start, &end);
+    SearchReplacement replacement = { chr, g_utf8_strlen(scan->text + start, end - start), NULL };
+    replacement.text = g_match_info_expand_references(info, scan->job->replacement, NULL);
+    if (replacement.text) {
+        g_array_append_val(scan->results, replacement);
+    }
+}
+
+// Non-overlapping regex matches with capture references in the replacement expanded
+static GArray *collect_replacements(SearchJob *job, GCancellable *cancellable) {
+    gsize length;
+    gchar *copy;
+    RegexScan scan = { job, NULL, NULL, 0, new_replacements() };
+
+    scan.text = scan.counted = snapshot_text(job->snapshot, &length, &copy);
+    match_regex(&scan, length, cancellable, add_regex_replacement);
+    g_free(copy);
+    return scan.results;
+}
+
+static GArray *narrow_matches(SearchJob *job, GCancellable *cancellable) {
+    GArray *matches = g_array_new(FALSE, FALSE, sizeof(SearchMatch));
+    gsize query_len = strlen(job->query);
+    gsize query_chars = g_utf8_strlen(job->query, -1);
+    DocCursor cursor;
+
+    doc_cursor_init(&cursor, job->snapshot);
+    for (guint i = 0; i < job->candidates->len; i++) {
+        SearchMatch *candidate = &g_array_index(job->candidates, SearchMatch, i);
+        if (doc_cursor_equal(&cursor, candidate->byte, job->query, query_len, job->match_case)) {
+            SearchMatch match = { candidate->byte, candidate->chr, query_chars };
+            g_array_append_val(matches, match);
+        }
+        if (i % SEARCH_CANCEL_CHECK == 0 && g_cancellable_is_cancelled(cancellable)) {
+            break;
+        }
+    }
+    return matches;
+}
+
+static void search_thread(GTask *task, gpointer source, gpointer task_data, GCancellable *cancellable) {
+    SearchJob *job = task_data;
+    GArray *matches;
+
+    if (job->replacement && job->regex) {
+        matches = collect_replacements(job, cancellable);
+    } else if (job->replacement) {
+        matches = collect_literal_replacements(job, cancellable);
+    } else if (job->regex) {
+        matches = scan_regex(job, cancellable);
+    } else if (job->candidates) {
+        matches = narrow_matches(job, cancellable);
+    } else {
+        matches = scan_snapshot(job, TRUE, cancellable);
+    }
+
+    if (g_cancellable_is_cancelled(cancellable)) {
+        g_array_unref(matches);
+        g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_CANCELLED, "Search cancelled");
+        return;
+    }
+    g_task_return_pointer(task, matches, (GDestroyNotify) g_array_unref);
+}
+
+static void update_label(void) {
+    gchar *text;
+
+    if (!search.query || !*search.query) {
+        text = g_strdup("");
+    } else if (search.invalid_pattern) {
+        text = g_strdup("Invalid pattern");
+    } else if (!search.matches) {
+        text = g_strdup("Searching…");
+    } else if (search.matches->len == 0) {
+        text = g_strdup("No results");
+    } else if (search.current >= 0) {
+        text = g_strdup_printf("%d of %u", search.current + 1, search.matches->len);
+    } else {
+        text = g_strdup_printf("%u matches", search.matches->len);
+    }
+    gtk_label_set_text(GTK_LABEL(editor->search_label), text);
+    g_free(text);
+}
+
+static void clear_highlight(void) {
+    GtkTextIter start, end;
+
+    if (!search.highlight_start) {
+        return;
+    }
+    gtk_text_buffer_get_iter_at_mark(editor->buffer, &start, search.highlight_start);
+    gtk_text_buffer_get_iter_at_mark(editor->buffer, &end, search.highlight_end);
+    gtk_text_buffer_remove_tag(editor->buffer, search.tag, &start, &end);
+    gtk_text_buffer_delete_mark(editor->buffer, search.highlight_start);
+    gtk_text_buffer_delete_mark(editor->buffer, search.highlight_end);
+    search.highlight_start = NULL;
+    search.highlight_end = NULL;
+}
+
+// First match starting at or after char_offset
+static guint lower_bound(gsize char_offset) {
+    guint low = 0, high = search.matches->len;
+    while (low < high) {
+        guint mid = (low + high) / 2;
+        if (g_array_index(search.matches, SearchMatch, mid).chr < char_offset) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Tags only the matches inside the visible region; called from the refresh pipeline
+void search_update_highlight(void) {
+    clear_highlight();
+    if (!search.matches || search.matches->len == 0 || viewer_is_active()) {
+        return;
+    }
+
+    GtkTextView *view = GTK_TEXT_VIEW(editor->text_view);
+    GdkRectangle visible;
+    GtkTextIter start, end;
+    gtk_text_view_get_visible_rect(view, &visible);
+    gtk_text_view_get_line_at_y(view, &start, visible.y, NULL);
+    gtk_text_view_get_line_at_y(view, &end, visible.y + visible.height, NULL);
+    gtk_text_iter_forward_to_line_end(&end);
+
+    gsize first = gtk_text_iter_get_offset(&start);
+    gsize last = gtk_text_iter_get_offset(&end);
+    gsize covered = last;
+    guint applied = 0;
+
+    for (guint i = lower_bound(first); i < search.matches->len && applied < SEARCH_MAX_HIGHLIGHTS; i++, applied++) {
+        SearchMatch *match = &g_array_index(search.matches, SearchMatch, i);
+        if (match->chr >= last) {
+            break;
+        }
+        GtkTextIter match_start, match_end;
+        gtk_text_buffer_get_iter_at_offset(editor->buffer, &match_start, match->chr);
+        gtk_text_buffer_get_iter_at_offset(editor->buffer, &match_end, match->chr + match->chars);
+        gtk_text_buffer_apply_tag(editor->buffer, search.tag, &match_start, &match_end);
+        covered = MAX(covered, match->chr + match->chars);
+    }
+
+    gtk_text_buffer_get_iter_at_offset(editor->buffer, &end, covered);
+    search.highlight_start = gtk_text_buffer_create_mark(editor->buffer, NULL, &start, TRUE);
+    search.highlight_end = gtk_text_buffer_create_mark(editor->buffer, NULL, &end, FALSE);
+}
+
+static void select_match(gint index) {
+    SearchMatch *match = &g_array_index(search.matches, SearchMatch, index);
+    GtkTextIter start, end;
+
+    search.current = index;
+    gtk_text_buffer_get_iter_at_offset(editor->buffer, &start, match->chr);
+    gtk_text_buffer_get_iter_at_offset(editor->buffer, &end, match->chr + match->chars);
+    gtk_text_buffer_select_range(editor->buffer, &start, &end);
+    gtk_text_view_scroll_to_iter(GTK_TEXT_VIEW(editor->text_view), &start, 0.0, FALSE, 0.0, 0.0);
+    update_label();
+}
+
+static gsize cursor_offset(void) {
+    GtkTextIter iter;
+    gtk_text_buffer_get_iter_at_mark(editor->buffer, &iter, gtk_text_buffer_get_insert(editor->buffer));
+    return gtk_text_iter_get_offset(&iter);
+}
+
+static void on_search_done(GObject *source, GAsyncResult *result, gpointer data) {
+    SearchJob *job = g_task_get_task_data(G_TASK(result));
+    GArray *matches = g_task_propagate_pointer(G_TASK(result), NULL);
+
+    if (!matches) {
+        return;
+    }
+    if (g_cancellable_is_cancelled(g_task_get_cancellable(G_TASK(result)))) {
+        g_array_unref(matches);
+        return;
+    }
+
+    search.matches = matches;
+    search.snapshot = doc_snapshot_ref(job->snapshot);
+    search.current = -1;
+    g_clear_object(&search.cancellable);
+
+    if (job->jump && matches->len > 0) {
+        guint index = lower_bound(cursor_offset());
+        select_match(index < matches->len ? index : 0);
+    }
+    update_label();
+    schedule_refresh(REFRESH_SEARCH);
+}
+
+static void cancel_search(void) {
+    if (search.cancellable) {
+        g_cancellable_cancel(search.cancellable);
+        g_clear_object(&search.cancellable);
+    }
+    if (search.rescan_source) {
+        g_source_remove(search.rescan_source);
+        search.rescan_source = 0;
+    }
+}
+
+static void drop_results(void) {
+    if (search.matches) {
+        g_array_unref(search.matches);
+        search.matches = NULL;
+    }
+    if (search.snapshot) {
+        doc_snapshot_unref(search.snapshot);
+        search.snapshot = NULL;
+    }
+    search.current = -1;
+}
+
+static void start_search(const gchar *query, gboolean match_case, gboolean use_regex, gboolean jump) {
+    SearchJob *job = g_new0(SearchJob, 1);
+
+    // A longer literal query over the same document only needs to re-check the previous matches
+    if (search.matches && search.change_seq == editor->change_seq && search.match_case == match_case &&
+        !use_regex && !search.use_regex && search.query && g_str_has_prefix(query, search.query)) {
+        job->candidates = g_array_ref(search.matches);
+    }
+
+    cancel_search();
+    drop_results();
+    g_free(search.query);
+    search.query = g_strdup(query);
+    search.match_case = match_case;
+    search.use_regex = use_regex;
+    search.change_seq = editor->change_seq;
+
+    if (use_regex) {
+        job->regex = search_compile_regex(query, match_case, 0, NULL);
+    }
+    search.invalid_pattern = use_regex && !job->regex;
+    if (search.invalid_pattern) {
+        free_job(job);
+        update_label();
+        return;
+    }
+
+    job->snapshot = document_snapshot(editor->document);
+    job->query = g_strdup(query);
+    job->match_case = match_case;
+    job->jump = jump;
+    search.cancellable = g_cancellable_new();
+
+    GTask *task = g_task_new(NULL, search.cancellable, on_search_done, NULL);
+    g_task_set_task_data(task, job, free_job);
+    g_task_run_in_thread(task, search_thread);
+    g_object_unref(task);
+    update_label();
+}
+
+void search_set_query(const gchar *query, gboolean match_case, gboolean use_regex) {
+    if (!*query) {
+        search_clear();
+        return;
+    }
+    start_search(query, match_case, use_regex, TRUE);
+}
+
+static void on_replace_done(GObject *source, GAsyncResult *result, gpointer data) {
+    SearchJob *job = g_task_get_task_data(G_TASK(result));
+    GArray *replacements = g_task_propagate_pointer(G_TASK(result), NULL);
+
+    if (!replacements) {
+        return;
+    }
+    if (g_cancellable_is_cancelled(g_task_get_cancellable(G_TASK(result)))) {
+        g_array_unref(replacements);
+        return;
+    }
+    g_clear_object(&search.replace_cancellable);
+
+    // Offsets refer to the snapshot; an edit in the meantime means starting over
+    if (job->change_seq != editor->change_seq) {
+        g_array_unref(replacements);
+        search_replace_all(job->replacement);
+        return;
+    }
+
+    // Back to front so earlier offsets stay valid; one user action so it undoes as a single step
+    gtk_text_buffer_begin_user_action(editor->buffer);
+    for (guint i = replacements->len; i-- > 0;) {
+        SearchReplacement *replacement = &g_array_index(replacements, SearchReplacement, i);
+        GtkTextIter start, end;
+        gtk_text_buffer_get_iter_at_offset(editor->buffer, &start, replacement->chr);
+        gtk_text_buffer_get_iter_at_offset(editor->buffer, &end, replacement->chr + replacement->chars);
+        gtk_text_buffer_delete(editor->buffer, &start, &end);
+        gtk_text_buffer_insert(editor->buffer, &start, replacement->text, -1);
+    }
+    gtk_text_buffer_end_user_action(editor->buffer);
+    g_array_unref(replacements);
+}
+
+void search_replace_all(const gchar *replacement) {
+    if (!search.query || search.invalid_pattern) {
+        return;
+    }
+    if (search.replace_cancellable) {
+        g_cancellable_cancel(search.replace_cancellable);
+        g_clear_object(&search.replace_cancellable);
+    }
+
+    // A template that cannot be expanded (e.g. a trailing backslash) would silently skip every match
+    GError *error = NULL;
+    if (search.use_regex && !g_regex_check_replacement(replacement, NULL, &error)) {
+        gtk_label_set_text(GTK_LABEL(editor->search_label), error->message);
+        g_error_free(error);
+        return;
+    }
+
+    SearchJob *job = g_new0(SearchJob, 1);
+    if (search.use_regex && !(job->regex = search_compile_regex(search.query, search.match_case, 0, NULL))) {
+        free_job(job);
+        return;
+    }
+    job->snapshot = document_snapshot(editor->document);
+    job->query = g_strdup(search.query);
+    job->replacement = g_strdup(replacement);
+    job->match_case = search.match_case;
+    job->change_seq = editor->change_seq;
+    search.replace_cancellable = g_cancellable_new();
+
+    GTask *task = g_task_new(NULL, search.replace_cancellable, on_replace_done, NULL);
+    g_task_set_task_data(task, job, free_job);
+    g_task_run_in_thread(task, search_thread);
+    g_object_unref(task);
+}
+
+void search_clear(void) {
+    cancel_search();
+    drop_results();
+    clear_highlight();
+    g_free(search.query);
+    search.query = NULL;
+    search.invalid_pattern = FALSE;
+    update_label();
+}
+
+// A scan is running and its results are not in yet
+gboolean search_in_progress(void) {
+    return search.cancellable != NULL;
+}
+
+static gboolean on_rescan_timeout(gpointer data) {
+    search.rescan_source = 0;
+    gchar *query = g_strdup(search.query);
+    start_search(query, search.match_case, search.use_regex, FALSE);
+    g_free(query);
+    return G_SOURCE_REMOVE;
+}
+
+// Results refer to an older document version after an edit; recompute them shortly
+void search_document_changed(void) {
+    if (!search.query) {
+        return;
+    }
+    if (search.cancellable) {
+        g_cancellable_cancel(search.cancellable);
+        g_clear_object(&search.cancellable);
+    }
+    drop_results();
+    update_label();
+
+    if (search.rescan_source) {
+        g_source_remove(search.rescan_source);
+    }
+    search.rescan_source = g_timeout_add(SEARCH_RESCAN_DELAY, on_rescan_timeout, NULL);
+}
+
+void search_next(gboolean backward) {
+    if (!search.matches || search.matches->len == 0) {
+        return;
+    }
+
+    gsize offset = cursor_offset();
+    guint count = search.matches->len;
+    gboolean on_match = search.current >= 0 &&
+                        g_array_index(search.matches, SearchMatch, search.current).chr == offset;
+    guint index = lower_bound(offset);
+
+    if (backward) {
+        select_match(index == 0 ? count - 1 : index - 1);
+    } else if (on_match) {
+        select_match((search.current + 1) % count);
+    } else {
+        select_match(index < count ? index : 0);
+    }
+}
+
+static void on_search_view_scrolled(GtkAdjustment *adjustment, gpointer data) {
+    if (search.matches) {
+        schedule_refresh(REFRESH_SEARCH);
+    }
+}
+
+void setup_search(void) {
+    GdkRGBA color = {1.0, 0.8, 0.0, 0.35};
+    search.current = -1;
+    search.tag = gtk_text_buffer_create_tag(editor->buffer, "search-match", "background-rgba", &color, NULL);
+
+    // Highlights follow the visible region
+    GtkAdjustment *vadjustment = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(editor->text_view));
+    g_signal_connect(vadjustment, "value-changed", G_CALLBACK(on_search_view_scrolled), NULL);
+    g_signal_connect(vadjustment, "changed", G_CALLBACK(on_search_view_scrolled), NULL);
+}
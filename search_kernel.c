@@ -0,0 +1,196 @@
+#include "header.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define SEARCH_KERNEL_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define SEARCH_KERNEL_NEON 1
+#include <arm_neon.h>
+#endif
+
+// Substring search over contiguous UTF-8: SIMD blocks keep only positions where both the first and
+// the last needle byte match, and just those candidates are compared in full.
+// Case-insensitive matching folds ASCII letters only.
+
+typedef const gchar *(*SearchKernel)(const gchar *, gsize, const gchar *, gsize, gboolean);
+
+static gboolean equal_bytes(const gchar *a, const gchar *b, gsize length, gboolean match_case) {
+    if (match_case) {
+        return memcmp(a, b, length) == 0;
+    }
+    for (gsize i = 0; i < length; i++) {
+        if (g_ascii_tolower(a[i]) != g_ascii_tolower(b[i])) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static const gchar *find_scalar(const gchar *haystack, gsize length, const gchar *needle,
+                                gsize needle_length, gboolean match_case) {
+    const gchar *end = haystack + length;
+    const gchar *p = haystack;
+
+    if (match_case) {
+        while ((p = memchr(p, needle[0], end - p - needle_length + 1)) != NULL) {
+            if (memcmp(p, needle, needle_length) == 0) {
+                return p;
+            }
+            if (++p > end - needle_length) {
+                break;
+            }
+        }
+        return NULL;
+    }
+
+    gchar first = g_ascii_tolower(needle[0]);
+    for (; p <= end - needle_length; p++) {
+        if (g_ascii_tolower(*p) == first && equal_bytes(p, needle, needle_length, FALSE)) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+#ifdef SEARCH_KERNEL_X86
+static const gchar *find_sse2(const gchar *haystack, gsize length, const gchar *needle,
+                              gsize needle_length, gboolean match_case) {
+    gchar first_byte = match_case ? needle[0] : g_ascii_tolower(needle[0]);
+    gchar last_byte = match_case ? needle[needle_length - 1] : g_ascii_tolower(needle[needle_length - 1]);
+    const __m128i first = _mm_set1_epi8(first_byte);
+    const __m128i last = _mm_set1_epi8(last_byte);
+    const __m128i first_upper = _mm_set1_epi8(match_case ? first_byte : g_ascii_toupper(first_byte));
+    const __m128i last_upper = _mm_set1_epi8(match_case ? last_byte : g_ascii_toupper(last_byte));
+    gsize i = 0;
+
+    for (; i + needle_length + 15 <= length; i += 16) {
+        __m128i block_first = _mm_loadu_si128((const __m128i *) (haystack + i));
+        __m128i block_last = _mm_loadu_si128((const __m128i *) (haystack + i + needle_length - 1));
+        __m128i eq_first = _mm_or_si128(_mm_cmpeq_epi8(block_first, first), _mm_cmpeq_epi8(block_first, first_upper));
+        __m128i eq_last = _mm_or_si128(_mm_cmpeq_epi8(block_last, last), _mm_cmpeq_epi8(block_last, last_upper));
+        guint mask = _mm_movemask_epi8(_mm_and_si128(eq_first, eq_last));
+
+        while (mask) {
+            guint bit = __builtin_ctz(mask);
+            if (equal_bytes(haystack + i + bit, needle, needle_length, match_case)) {
+                return haystack + i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+
+    if (i + needle_length > length) {
+        return NULL;
+    }
+    return find_scalar(haystack + i, length - i, needle, needle_length, match_case);
+}
+
+__attribute__((target("avx2")))
+static const gchar *find_avx2(const gchar *haystack, gsize length, const gchar *needle,
+                              gsize needle_length, gboolean match_case) {
+    gchar first_byte = match_case ? needle[0] : g_ascii_tolower(needle[0]);
+    gchar last_byte = match_case ? needle[needle_length - 1] : g_ascii_tolower(needle[needle_length - 1]);
+    const __m256i first = _mm256_set1_epi8(first_byte);
+    const __m256i last = _mm256_set1_epi8(last_byte);
+    const __m256i first_upper = _mm256_set1_epi8(match_case ? first_byte : g_ascii_toupper(first_byte));
+    const __m256i last_upper = _mm256_set1_epi8(match_case ? last_byte : g_ascii_toupper(last_byte));
+    gsize i = 0;
+
+    for (; i + needle_length + 31 <= length; i += 32) {
+        __m256i block_first = _mm256_loadu_si256((const __m256i *) (haystack + i));
+        __m256i block_last = _mm256_loadu_si256((const __m256i *) (haystack + i + needle_length - 1));
+        __m256i eq_first = _mm256_or_si256(_mm256_cmpeq_epi8(block_first, first), _mm256_cmpeq_epi8(block_first, first_upper));
+        __m256i eq_last = _mm256_or_si256(_mm256_cmpeq_epi8(block_last, last), _mm256_cmpeq_epi8(block_last, last_upper));
+        guint32 mask = (guint32) _mm256_movemask_epi8(_mm256_and_si256(eq_first, eq_last));
+
+        while (mask) {
+            guint bit = __builtin_ctz(mask);
+            if (equal_bytes(haystack + i + bit, needle, needle_length, match_case)) {
+                return haystack + i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+
+    if (i + needle_length > length) {
+        return NULL;
+    }
+    return find_sse2(haystack + i, length - i, needle, needle_length, match_case);
+}
+#endif
+
+#ifdef SEARCH_KERNEL_NEON
+static const gchar *find_neon(const gchar *haystack, gsize length, const gchar *needle,
+                              gsize needle_length, gboolean match_case) {
+    guint8 first_byte = match_case ? needle[0] : g_ascii_tolower(needle[0]);
+    guint8 last_byte = match_case ? needle[needle_length - 1] : g_ascii_tolower(needle[needle_length - 1]);
+    const uint8x16_t first = vdupq_n_u8(first_byte);
+    const uint8x16_t last = vdupq_n_u8(last_byte);
+    const uint8x16_t first_upper = vdupq_n_u8(match_case ? first_byte : g_ascii_toupper(first_byte));
+    const uint8x16_t last_upper = vdupq_n_u8(match_case ? last_byte : g_ascii_toupper(last_byte));
+    gsize i = 0;
+
+    for (; i + needle_length + 15 <= length; i += 16) {
+        uint8x16_t block_first = vld1q_u8((const guint8 *) haystack + i);
+        uint8x16_t block_last = vld1q_u8((const guint8 *) haystack + i + needle_length - 1);
+        uint8x16_t eq_first = vorrq_u8(vceqq_u8(block_first, first), vceqq_u8(block_first, first_upper));
+        uint8x16_t eq_last = vorrq_u8(vceqq_u8(block_last, last), vceqq_u8(block_last, last_upper));
+        uint8x16_t eq = vandq_u8(eq_first, eq_last);
+
+        // Narrow to a 64-bit mask with four bits per byte (NEON has no movemask)
+        guint64 mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+        while (mask) {
+            guint bit = __builtin_ctzll(mask) >> 2;
+            if (equal_bytes(haystack + i + bit, needle, needle_length, match_case)) {
+                return haystack + i + bit;
+            }
+            mask &= ~(G_GUINT64_CONSTANT(0xF) << (bit * 4));
+        }
+    }
+
+    if (i + needle_length > length) {
+        return NULL;
+    }
+    return find_scalar(haystack + i, length - i, needle, needle_length, match_case);
+}
+#endif
+
+static SearchKernel select_kernel(void) {
+#ifdef SEARCH_KERNEL_X86
+    if (__builtin_cpu_supports("avx2")) {
+        return find_avx2;
+    }
+    return find_sse2;
+#elif defined(SEARCH_KERNEL_NEON)
+    return find_neon;
+#else
+    return find_scalar;
+#endif
+}
+
+const gchar *search_find(const gchar *haystack, gsize length, const gchar *needle,
+                         gsize needle_length, gboolean match_case) {
+    static SearchKernel kernel = NULL;
+    static gsize kernel_ready = 0;
+
+    if (needle_length == 0 || needle_length > length) {
+        return NULL;
+    }
+    if (needle_length == 1 && match_case) {
+        return memchr(haystack, needle[0], length);
+    }
+
+    if (g_once_init_enter(&kernel_ready)) {
+        kernel = select_kernel();
+        g_once_init_leave(&kernel_ready, 1);
+    }
+    return kernel(haystack, length, needle, needle_length, match_case);
+}
+
+const gchar *search_find_scalar(const gchar *haystack, gsize length, const gchar *needle,
+                                gsize needle_length, gboolean match_case) {
+    if (needle_length == 0 || needle_length > length) {
+        return NULL;
+    }
+    return find_scalar(haystack, length, needle, needle_length, match_case);
+}
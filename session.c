@@ -0,0 +1,180 @@
+#include "header.h"
+#include <glib/gstdio.h>
+
+#define SESSION_SAVE_DELAY 2        // Seconds between a change and the write that records it
+#define SESSION_PAINT_HISTORY 20    // First-paint times kept in the session file
+
+static struct {
+    gchar *path;
+    guint save_source;
+    gint64 started;             // Monotonic time at startup
+    gint split;                 // Editor/terminal divider, 0 if never moved
+    gint *paint_history;        // Milliseconds to first paint on recent startups, oldest first
+    gsize n_paint_history;
+    gulong draw_handler;
+    gboolean closed;            // Written for the last time; the widgets may be gone
+} session;
+
+static gboolean on_save_timeout(gpointer data) {
+    session.save_source = 0;
+    session_save();
+    return G_SOURCE_REMOVE;
+}
+
+// Coalesces bursts of changes (typing, scrolling, switching tabs) into one write
+void session_changed(void) {
+    if (!session.save_source && !session.closed && session.path) {
+        session.save_source = g_timeout_add_seconds(SESSION_SAVE_DELAY, on_save_timeout, NULL);
+    }
+}
+
+void session_save(void) {
+    if (session.closed || !session.path) {
+        return;
+    }
+    if (session.save_source) {
+        g_source_remove(session.save_source);
+        session.save_source = 0;
+    }
+
+    GKeyFile *file = g_key_file_new();
+    guint count = documents_get_count();
+    GPtrArray *files = g_ptr_array_new();
+    GArray *lines = g_array_new(FALSE, FALSE, sizeof(gint));
+    GArray *tops = g_array_new(FALSE, FALSE, sizeof(gint));
+    gint active = -1;
+
+    // Untitled tabs have nothing on disk to come back to
+    for (guint i = 0; i < count; i++) {
+        gint64 line, top_line;
+        const gchar *filename = documents_get_tab(i, &line, &top_line);
+        if (!filename) {
+            continue;
+        }
+        if ((gint) i == documents_get_active()) {
+            active = files->len;
+        }
+        gint line32 = (gint) MIN(line, G_MAXINT);
+        gint top32 = (gint) MIN(top_line, G_MAXINT);
+        g_ptr_array_add(files, (gpointer) filename);
+        g_array_append_val(lines, line32);
+        g_array_append_val(tops, top32);
+    }
+    g_ptr_array_add(files, NULL);
+
+    g_key_file_set_string_list(file, "session", "files", (const gchar *const *) files->pdata, files->len - 1);
+    g_key_file_set_integer_list(file, "session", "lines", (gint *) lines->data, lines->len);
+    g_key_file_set_integer_list(file, "session", "top-lines", (gint *) tops->data, tops->len);
+    g_key_file_set_integer(file, "session", "active", active);
+    g_key_file_set_integer(file, "session", "terminal-split", session.split);
+    gchar *cwd = terminal_current_directory();
+    if (cwd) {
+        g_key_file_set_string(file, "session", "terminal-cwd", cwd);
+        g_free(cwd);
+    }
+    if (session.n_paint_history > 0) {
+        g_key_file_set_integer_list(file, "startup", "first-paint-ms", session.paint_history, session.n_paint_history);
+    }
+
+    GError *error = NULL;
+    gchar *dir = g_path_get_dirname(session.path);
+    g_mkdir_with_parents(dir, 0700);
+    if (!g_key_file_save_to_file(file, session.path, &error)) {
+        g_warning("Could not write session %s: %s", session.path, error->message);
+        g_error_free(error);
+    }
+    g_free(dir);
+    g_ptr_array_free(files, TRUE);
+    g_array_free(lines, TRUE);
+    g_array_free(tops, TRUE);
+    g_key_file_free(file);
+}
+
+// Last write, while the widgets still exist; later calls do nothing
+void session_close(void) {
+    session_save();
+    session.closed = TRUE;
+}
+
+static void on_split_changed(GObject *paned, GParamSpec *pspec, gpointer data) {
+    if (editor->terminal_visible) {
+        session.split = gtk_paned_get_position(GTK_PANED(paned));
+        session_changed();
+    }
+}
+
+// Everything not needed for the first frame waits until it has been drawn
+static gboolean on_startup_idle(gpointer data) {
+    if (editor->prewarm_terminal) {
+        terminal_ensure();
+    }
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean on_first_draw(GtkWidget *widget, cairo_t *cr, gpointer data) {
+    gint64 elapsed = g_get_monotonic_time() - session.started;
+    gint ms = (gint) (elapsed / 1000);
+
+    g_signal_handler_disconnect(widget, session.draw_handler);
+    g_debug("First paint after %d ms", ms);
+
+    // Keep a short history so startup regressions show up across runs
+    if (session.n_paint_history == SESSION_PAINT_HISTORY) {
+        memmove(session.paint_history, session.paint_history + 1, (SESSION_PAINT_HISTORY - 1) * sizeof(gint));
+        session.n_paint_history--;
+    }
+    session.paint_history = g_renew(gint, session.paint_history, session.n_paint_history + 1);
+    session.paint_history[session.n_paint_history++] = ms;
+    session_changed();
+
+    g_idle_add(on_startup_idle, NULL);
+    return FALSE;
+}
+
+// Reopens the previous session's tabs without reading them; only the active one starts loading
+void session_restore(gint64 started) {
+    GKeyFile *file = g_key_file_new();
+
+    session.started = started;
+    session.path = g_build_filename(g_get_user_data_dir(), "codepad", "session.ini", NULL);
+    session.draw_handler = g_signal_connect_after(editor->text_view, "draw", G_CALLBACK(on_first_draw), NULL);
+    g_signal_connect(editor->paned, "notify::position", G_CALLBACK(on_split_changed), NULL);
+
+    if (g_key_file_load_from_file(file, session.path, G_KEY_FILE_NONE, NULL)) {
+        gsize n_files = 0, n_lines = 0, n_tops = 0;
+        gchar **files = g_key_file_get_string_list(file, "session", "files", &n_files, NULL);
+        gint *lines = g_key_file_get_integer_list(file, "session", "lines", &n_lines, NULL);
+        gint *tops = g_key_file_get_integer_list(file, "session", "top-lines", &n_tops, NULL);
+        gint active = g_key_file_get_integer(file, "session", "active", NULL);
+
+        for (gsize i = 0; i < n_files; i++) {
+            documents_add(files[i], i < n_lines ? lines[i] : 0, i < n_tops ? tops[i] : 0);
+        }
+        if (active >= 0 && (gsize) active < n_files) {
+            documents_open(files[active]);
+        }
+        documents_remove_blank();
+
+        session.split = g_key_file_get_integer(file, "session", "terminal-split", NULL);
+        if (session.split > 0) {
+            gtk_paned_set_position(GTK_PANED(editor->paned), session.split);
+        }
+        g_free(editor->terminal_cwd);
+        editor->terminal_cwd = g_key_file_get_string(file, "session", "terminal-cwd", NULL);
+        if (editor->terminal_cwd && !g_file_test(editor->terminal_cwd, G_FILE_TEST_IS_DIR)) {
+            g_clear_pointer(&editor->terminal_cwd, g_free);
+        }
+        session.paint_history = g_key_file_get_integer_list(file, "startup", "first-paint-ms",
+                                                            &session.n_paint_history, NULL);
+        if (session.n_paint_history > SESSION_PAINT_HISTORY) {
+            memmove(session.paint_history, session.paint_history + session.n_paint_history - SESSION_PAINT_HISTORY,
+                    SESSION_PAINT_HISTORY * sizeof(gint));
+            session.n_paint_history = SESSION_PAINT_HISTORY;
+        }
+
+        g_strfreev(files);
+        g_free(lines);
+        g_free(tops);
+    }
+    g_key_file_free(file);
+}
@@ -0,0 +1,125 @@
+#include "header.h"
+
+static gboolean is_word_char(gunichar c) {
+    return c != 0 && !(c < 0x80 && g_ascii_isspace(c));
+}
+
+// Counts line breaks the way GtkTextBuffer does for "\n", "\r\n" and a lone "\r"
+gsize stats_count_newlines(const gchar *text, gsize len) {
+    gsize count = 0;
+    const gchar *p = text;
+    const gchar *end = text + len;
+
+    while ((p = memchr(p, '\n', end - p)) != NULL) {
+        count++;
+        p++;
+    }
+
+    // Carriage returns are rare, so only pay for a second pass when one exists
+    if (memchr(text, '\r', len)) {
+        for (p = text; p < end; p++) {
+            if (*p == '\r' && (p + 1 == end || p[1] != '\n')) {
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+static void scan_text(const gchar *text, gsize len, gint64 *chars, gint64 *words) {
+    gboolean in_word = FALSE;
+
+    *chars = 0;
+    *words = 0;
+    for (gsize i = 0; i < len; i++) {
+        guchar c = text[i];
+        if ((c & 0xC0) != 0x80) {
+            (*chars)++;
+        }
+        if (c < 0x80 && g_ascii_isspace(c)) {
+            in_word = FALSE;
+        } else if (!in_word) {
+            in_word = TRUE;
+            (*words)++;
+        }
+    }
+}
+
+// Adds (sign = 1) or removes (sign = -1) text that sits between the characters before and after
+static void apply_delta(DocStats *stats, gunichar before, gunichar after,
+                        const gchar *text, gsize len, gint sign) {
+    if (len == 0) {
+        return;
+    }
+
+    gint64 chars, words;
+    gint64 lines = stats_count_newlines(text, len);
+    scan_text(text, len, &chars, &words);
+
+    // Words that touch the edit boundary merge with their neighbours
+    guchar first = text[0];
+    guchar last = text[len - 1];
+    gboolean word_before = is_word_char(before);
+    gboolean word_after = is_word_char(after);
+    words -= word_before && is_word_char(first);
+    words -= word_after && is_word_char(last);
+    words += word_before && word_after;
+
+    // So do "\r" and "\n" that form a single "\r\n" break across the boundary
+    lines -= before == '\r' && first == '\n';
+    lines -= last == '\r' && after == '\n';
+    lines += before == '\r' && after == '\n';
+
+    stats->lines += sign * lines;
+    stats->chars += sign * chars;
+    stats->bytes += sign * (gint64) len;
+    stats->words += sign * words;
+}
+
+static gunichar char_before(const GtkTextIter *iter) {
+    GtkTextIter prev = *iter;
+    return gtk_text_iter_backward_char(&prev) ? gtk_text_iter_get_char(&prev) : 0;
+}
+
+static void on_stats_insert_text(GtkTextBuffer *buffer, GtkTextIter *location,
+                                 gchar *text, gint len, gpointer data) {
+    apply_delta(data, char_before(location), gtk_text_iter_get_char(location), text, len, 1);
+}
+
+static void on_stats_delete_range(GtkTextBuffer *buffer, GtkTextIter *start,
+                                  GtkTextIter *end, gpointer data) {
+    DocStats *stats = data;
+
+    // Clearing the whole buffer (new file, reload) needs no scan at all
+    if (gtk_text_iter_is_start(start) && gtk_text_iter_is_end(end)) {
+        stats_reset(stats);
+        return;
+    }
+
+    gchar *text = gtk_text_buffer_get_slice(buffer, start, end, TRUE);
+    apply_delta(stats, char_before(start), gtk_text_iter_get_char(end), text, strlen(text), -1);
+    g_free(text);
+}
+
+void stats_reset(DocStats *stats) {
+    stats->lines = 1;
+    stats->chars = 0;
+    stats->bytes = 0;
+    stats->words = 0;
+}
+
+void stats_attach(GtkTextBuffer *buffer, DocStats *stats) {
+    GtkTextIter start, end;
+
+    stats_reset(stats);
+    gtk_text_buffer_get_bounds(buffer, &start, &end);
+    if (!gtk_text_iter_equal(&start, &end)) {
+        gchar *text = gtk_text_buffer_get_slice(buffer, &start, &end, TRUE);
+        apply_delta(stats, 0, 0, text, strlen(text), 1);
+        g_free(text);
+    }
+
+    // Default handlers run last, so these still see the text before it changes
+    g_signal_connect(buffer, "insert-text", G_CALLBACK(on_stats_insert_text), stats);
+    g_signal_connect(buffer, "delete-range", G_CALLBACK(on_stats_delete_range), stats);
+}
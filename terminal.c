@@ -8,29 +8,10 @@ static void on_terminal_spawn_callback(VteTerminal *terminal, GPid pid, GError *
     }
 }
 
-void setup_terminal(void) {
-    GtkWidget *terminal_box, *terminal_header, *terminal_label;
-
-    // Create terminal widget
-    editor->terminal = vte_terminal_new();
-
-    // Configure terminal properties
-    vte_terminal_set_scrollback_lines(VTE_TERMINAL(editor->terminal), 1000);
-    vte_terminal_set_mouse_autohide(VTE_TERMINAL(editor->terminal), TRUE);
-    vte_terminal_set_cursor_blink_mode(VTE_TERMINAL(editor->terminal), VTE_CURSOR_BLINK_ON);
-    vte_terminal_set_size(VTE_TERMINAL(editor->terminal), 80, 24);
-
-    // Set terminal colors
-    GdkRGBA bg_color = {0.12, 0.12, 0.12, 1.0};
-    GdkRGBA fg_color = {0.83, 0.83, 0.83, 1.0};
-    vte_terminal_set_color_background(VTE_TERMINAL(editor->terminal), &bg_color);
-    vte_terminal_set_color_foreground(VTE_TERMINAL(editor->terminal), &fg_color);
-
-    // Set font
-    PangoFontDescription *font_desc = pango_font_description_from_string("Monospace 10");
-    vte_terminal_set_font(VTE_TERMINAL(editor->terminal), font_desc);
-    pango_font_description_free(font_desc);
+// Holds the VTE widget once the panel has been revealed
+static GtkWidget *terminal_scroll = NULL;
 
+static void spawn_shell(void) {
     // Prepare environment and command
     char **envp = g_get_environ();
     const char *shell = g_getenv("SHELL") ? g_getenv("SHELL") : "/bin/bash";
@@ -41,7 +22,7 @@ void setup_terminal(void) {
 
     vte_terminal_spawn_async(VTE_TERMINAL(editor->terminal),
                              VTE_PTY_DEFAULT,
-                             NULL,
+                             editor->terminal_cwd,
                              argv,
                              envp,
                              G_SPAWN_SEARCH_PATH | G_SPAWN_FILE_AND_ARGV_ZERO,
@@ -54,6 +35,51 @@ void setup_terminal(void) {
 
     g_strfreev(argv);
     g_strfreev(envp);
+}
+
+static void on_terminal_directory_changed(VteTerminal *terminal, gpointer data) {
+    session_changed();
+}
+
+// Creates the VTE widget and starts the shell the first time the panel is needed
+void terminal_ensure(void) {
+    if (editor->terminal) {
+        return;
+    }
+
+    // Create terminal widget
+    editor->terminal = vte_terminal_new();
+
+    // Configure terminal properties
+    vte_terminal_set_scrollback_lines(VTE_TERMINAL(editor->terminal), 1000);
+    vte_terminal_set_mouse_autohide(VTE_TERMINAL(editor->terminal), TRUE);
+    vte_terminal_set_cursor_blink_mode(VTE_TERMINAL(editor->terminal), VTE_CURSOR_BLINK_ON);
+    vte_terminal_set_size(VTE_TERMINAL(editor->terminal), 80, 24);
+    theme_apply_terminal();
+
+    // Set font
+    PangoFontDescription *font_desc = pango_font_description_from_string("Monospace 10");
+    vte_terminal_set_font(VTE_TERMINAL(editor->terminal), font_desc);
+    pango_font_description_free(font_desc);
+    g_signal_connect(editor->terminal, "current-directory-uri-changed", G_CALLBACK(on_terminal_directory_changed), NULL);
+
+    gtk_container_add(GTK_CONTAINER(terminal_scroll), editor->terminal);
+    gtk_widget_show(editor->terminal);
+    spawn_shell();
+}
+
+// The shell's directory when it reports one (OSC 7), otherwise the one it was started in
+gchar *terminal_current_directory(void) {
+    const gchar *uri = editor->terminal ? vte_terminal_get_current_directory_uri(VTE_TERMINAL(editor->terminal)) : NULL;
+    gchar *path = uri ? g_filename_from_uri(uri, NULL, NULL) : NULL;
+
+    return path ? path : g_strdup(editor->terminal_cwd);
+}
+
+void setup_terminal(void) {
+    GtkWidget *terminal_box, *terminal_header, *terminal_label;
+
+    // The VTE widget and the shell are created by terminal_ensure() on first reveal
 
     // Create terminal container
     editor->terminal_container = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
@@ -78,12 +104,10 @@ void setup_terminal(void) {
     gtk_box_pack_start(GTK_BOX(editor->terminal_container), terminal_header, FALSE, FALSE, 0);
 
     // Terminal in scrolled window
-    GtkWidget *terminal_scroll = gtk_scrolled_window_new(NULL, NULL);
+    terminal_scroll = gtk_scrolled_window_new(NULL, NULL);
     gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(terminal_scroll),
                                    GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
     gtk_widget_set_size_request(terminal_scroll, -1, 200);
-    
-    gtk_container_add(GTK_CONTAINER(terminal_scroll), editor->terminal);
     gtk_box_pack_start(GTK_BOX(editor->terminal_container), terminal_scroll, TRUE, TRUE, 0);
 
     // Add terminal to paned widget
@@ -0,0 +1,109 @@
+#include "header.h"
+
+// Built-in themes, used when no theme file is installed. Zoom is handled per view in editor.c.
+static const gchar *builtin_css[2] = {
+    "window { background-color: #ffffff; color: #333333; }"
+    "textview { background-color: #ffffff; color: #333333; padding: 12px; }"
+    ".line-numbers { background-color: #f8f8f8; color: #999999; border-right: 1px solid #e0e0e0; }"
+    "headerbar { background: #f0f0f0; border-bottom: 1px solid #d0d0d0; }"
+    "headerbar button { background: #ffffff; border: 1px solid #ccc; color: #333; }"
+    "statusbar { background-color: #0078d4; color: white; }"
+    ".terminal-header { background-color: #e0e0e0; border-bottom: 1px solid #ccc; }"
+    ".perf-overlay { background-color: rgba(255, 255, 255, 0.9); color: #333333; font-family: monospace; padding: 6px; }",
+
+    "window { background-color: #1e1e1e; color: #d4d4d4; }"
+    "textview { background-color: #1e1e1e; color: #d4d4d4; padding: 12px; }"
+    ".line-numbers { background-color: #252526; color: #858585; border-right: 1px solid #3c3c3c; }"
+    "headerbar { background: #3c3c3c; border-bottom: 1px solid #1e1e1e; }"
+    "headerbar button { background: #404040; border: 1px solid #555; color: #d4d4d4; }"
+    "statusbar { background-color: #007acc; color: white; }"
+    ".terminal-header { background-color: #2d2d30; border-bottom: 1px solid #555; }"
+    ".perf-overlay { background-color: rgba(37, 37, 38, 0.9); color: #d4d4d4; font-family: monospace; padding: 6px; }"
+};
+static const gchar *theme_names[2] = { "light", "dark" };
+
+static struct {
+    GtkCssProvider *themes[2];      // Indexed by dark_mode; built once
+    GtkCssProvider *active;
+    guint n_providers;              // Providers currently attached to the screen
+} theme;
+
+// First match wins: the user's config directory, then the system data directories
+static gchar *find_theme_file(const gchar *name) {
+    gchar *basename = g_strconcat(name, ".css", NULL);
+    gchar *path = g_build_filename(g_get_user_config_dir(), "codepad", "themes", basename, NULL);
+    const gchar *const *dirs = g_get_system_data_dirs();
+
+    for (gint i = 0; dirs[i] && !g_file_test(path, G_FILE_TEST_IS_REGULAR); i++) {
+        g_free(path);
+        path = g_build_filename(dirs[i], "codepad", "themes", basename, NULL);
+    }
+    if (!g_file_test(path, G_FILE_TEST_IS_REGULAR)) {
+        g_clear_pointer(&path, g_free);
+    }
+    g_free(basename);
+    return path;
+}
+
+static GtkCssProvider *load_theme(gint index) {
+    GtkCssProvider *provider = gtk_css_provider_new();
+    gchar *path = find_theme_file(theme_names[index]);
+    GError *error = NULL;
+
+    if (path && !gtk_css_provider_load_from_path(provider, path, &error)) {
+        g_warning("Ignoring theme %s: %s", path, error->message);
+        g_clear_error(&error);
+        g_clear_pointer(&path, g_free);
+    }
+    if (!path) {
+        gtk_css_provider_load_from_data(provider, builtin_css[index], -1, NULL);
+    }
+    g_free(path);
+    return provider;
+}
+
+void theme_apply_terminal(void) {
+    GdkRGBA bg_color = {1.0, 1.0, 1.0, 1.0};
+    GdkRGBA fg_color = {0.2, 0.2, 0.2, 1.0};
+
+    if (!editor->terminal) {
+        return;
+    }
+    if (editor->dark_mode) {
+        bg_color = (GdkRGBA) {0.12, 0.12, 0.12, 1.0};
+        fg_color = (GdkRGBA) {0.83, 0.83, 0.83, 1.0};
+    }
+    vte_terminal_set_color_background(VTE_TERMINAL(editor->terminal), &bg_color);
+    vte_terminal_set_color_foreground(VTE_TERMINAL(editor->terminal), &fg_color);
+}
+
+// Swaps the one active theme provider
+void apply_theme(void) {
+    GdkScreen *screen = gdk_screen_get_default();
+    GtkCssProvider *wanted = theme.themes[editor->dark_mode ? 1 : 0];
+    gint64 perf_start = perf_begin();
+
+    if (theme.active != wanted) {
+        if (theme.active) {
+            gtk_style_context_remove_provider_for_screen(screen, GTK_STYLE_PROVIDER(theme.active));
+            theme.n_providers--;
+        }
+        gtk_style_context_add_provider_for_screen(screen, GTK_STYLE_PROVIDER(wanted),
+                                                  GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
+        theme.active = wanted;
+        theme.n_providers++;
+        theme_apply_terminal();
+        highlight_apply_theme();
+    }
+    perf_end(PERF_APPLY_THEME, perf_start);
+}
+
+guint theme_provider_count(void) {
+    return theme.n_providers;
+}
+
+void setup_theme(void) {
+    for (gint i = 0; i < 2; i++) {
+        theme.themes[i] = load_theme(i);
+    }
+}
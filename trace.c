@@ -0,0 +1,118 @@
+#include "header.h"
+
+// One complete span ('X') or counter sample ('C') in Chrome trace terms
+typedef struct {
+    const gchar *name;      // Static string
+    gchar phase;
+    gint64 start;           // Microseconds since trace.origin
+    gint64 duration;
+    gint64 value;
+} TraceEvent;
+
+static struct {
+    gboolean enabled;
+    gint64 origin;          // Monotonic time at the top of main()
+    gchar *output;          // Chrome trace JSON written here after first paint
+    GArray *events;
+    GdkFrameClock *clock;
+    gulong paint_handler;
+} trace;
+
+// Tracing costs a clock read per span, and nothing at all unless a profile was asked for
+void trace_init(gint64 origin, const gchar *output) {
+    trace.origin = origin;
+    if (output) {
+        trace.enabled = TRUE;
+        trace.output = g_strdup(output);
+        trace.events = g_array_new(FALSE, FALSE, sizeof(TraceEvent));
+    }
+}
+
+gint64 trace_begin(void) {
+    return trace.enabled ? g_get_monotonic_time() : 0;
+}
+
+void trace_end(const gchar *name, gint64 start) {
+    if (!trace.enabled) {
+        return;
+    }
+    TraceEvent event = { name, 'X', start - trace.origin, g_get_monotonic_time() - start, 0 };
+    g_array_append_val(trace.events, event);
+}
+
+void trace_counter(const gchar *name, gint64 value) {
+    if (!trace.enabled) {
+        return;
+    }
+    TraceEvent event = { name, 'C', g_get_monotonic_time() - trace.origin, 0, value };
+    g_array_append_val(trace.events, event);
+}
+
+static void write_chrome_trace(void) {
+    GString *json = g_string_new("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    GError *error = NULL;
+
+    for (guint i = 0; i < trace.events->len; i++) {
+        TraceEvent *event = &g_array_index(trace.events, TraceEvent, i);
+        if (event->phase == 'X') {
+            g_string_append_printf(json, "{\"name\":\"%s\",\"cat\":\"startup\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+                                   "\"ts\":%" G_GINT64_FORMAT ",\"dur\":%" G_GINT64_FORMAT "}",
+                                   event->name, event->start, event->duration);
+        } else {
+            g_string_append_printf(json, "{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"tid\":1,"
+                                   "\"ts\":%" G_GINT64_FORMAT ",\"args\":{\"value\":%" G_GINT64_FORMAT "}}",
+                                   event->name, event->start, event->value);
+        }
+        g_string_append(json, i + 1 < trace.events->len ? ",\n" : "\n");
+    }
+    g_string_append(json, "]}\n");
+
+    if (!g_file_set_contents(trace.output, json->str, json->len, &error)) {
+        g_printerr("Could not write %s: %s\n", trace.output, error->message);
+        g_error_free(error);
+    }
+    g_string_free(json, TRUE);
+}
+
+static void print_breakdown(void) {
+    g_print("Startup profile (ms since main):\n");
+    for (guint i = 0; i < trace.events->len; i++) {
+        TraceEvent *event = &g_array_index(trace.events, TraceEvent, i);
+        if (event->phase == 'X') {
+            g_print("  %-20s %8.2f  at %8.2f\n", event->name, event->duration / 1000.0, event->start / 1000.0);
+        } else {
+            g_print("  %-20s %8" G_GINT64_FORMAT "\n", event->name, event->value);
+        }
+    }
+    g_print("Chrome trace written to %s\n", trace.output);
+}
+
+// Runs once the first frame is on screen; the profile run ends here
+static gboolean on_profile_done(gpointer data) {
+    trace_counter("highlight-lines-lexed", (gint64) highlight_lines_lexed());
+    trace_counter("coalesced-refreshes", (gint64) refresh_coalesced_count());
+    write_chrome_trace();
+    print_breakdown();
+    gtk_main_quit();
+    return G_SOURCE_REMOVE;
+}
+
+static void on_after_paint(GdkFrameClock *clock, gpointer data) {
+    TraceEvent event = { "first-paint", 'X', 0, g_get_monotonic_time() - trace.origin, 0 };
+
+    g_signal_handler_disconnect(clock, trace.paint_handler);
+    g_array_append_val(trace.events, event);
+    g_idle_add(on_profile_done, NULL);
+}
+
+static void on_traced_widget_realize(GtkWidget *widget, gpointer data) {
+    trace.clock = gtk_widget_get_frame_clock(widget);
+    trace.paint_handler = g_signal_connect(trace.clock, "after-paint", G_CALLBACK(on_after_paint), NULL);
+}
+
+// Ends the profile on the first frame clock paint that includes widget
+void trace_watch_first_paint(GtkWidget *widget) {
+    if (trace.enabled) {
+        g_signal_connect(widget, "realize", G_CALLBACK(on_traced_widget_realize), NULL);
+    }
+}
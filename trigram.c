@@ -0,0 +1,702 @@
+#include "header.h"
+#include <glib/gstdio.h>
+#ifdef __linux__
+#include <glib-unix.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#define TRIGRAM_MAGIC "CPTRIGR"
+#define TRIGRAM_VERSION 1
+#define TRIGRAM_REBUILD_MIN 1000       // Dirty files tolerated before a rebuild...
+#define TRIGRAM_REBUILD_FRACTION 8     // ...or this fraction of the indexed files, whichever is larger
+#define TRIGRAM_REBUILD_DELAY 2        // s of quiet before a scheduled rebuild starts
+
+// On-disk layout, read in place from a mapping. Postings are varint-coded deltas between sorted file ids.
+typedef struct {
+    gchar magic[8];
+    guint32 version;
+    guint32 n_files;
+    guint32 n_trigrams;
+    guint32 reserved;
+    guint64 files_offset;       // TrigramFile[n_files]
+    guint64 table_offset;       // TrigramEntry[n_trigrams], sorted by trigram
+    guint64 postings_offset;
+    guint64 paths_offset;       // NUL-terminated paths relative to the root
+} TrigramHeader;
+
+typedef struct {
+    guint32 path;               // Offset into the path pool
+    guint32 reserved;
+    gint64 mtime;
+    gint64 size;
+} TrigramFile;
+
+typedef struct {
+    guint32 trigram;
+    guint32 count;
+    guint64 postings;           // Offset into the postings area
+} TrigramEntry;
+
+typedef struct {
+    gchar *relative;
+    gint64 mtime;
+    gint64 size;
+} WalkEntry;
+
+typedef struct {
+    GByteArray *postings;
+    guint32 last;
+    guint32 count;
+} PostingList;
+
+typedef struct {
+    gchar *root;
+    gchar *index_path;
+    GPtrArray *ignore;
+    GMappedFile *mapped;        // Index to check files against, or NULL to build a new one
+    guint generation;
+} IndexJob;
+
+typedef struct {
+    GPtrArray *dirs;            // Absolute directory paths to watch
+    GPtrArray *dirty;           // Absolute paths that differ from the index
+    GMappedFile *mapped;        // Newly built index
+} IndexResult;
+
+static struct {
+    gchar *root;
+    gchar *index_path;
+    GPtrArray *ignore;
+    GMappedFile *mapped;
+    const TrigramHeader *header;
+    GHashTable *dirty;          // Absolute path -> generation it was dirtied in
+    guint generation;
+    GCancellable *cancellable;
+    gboolean busy;              // Build or check running
+    guint rebuild_source;
+    gint inotify_fd;
+    guint inotify_source;
+    GHashTable *watches;        // Watch descriptor -> directory path
+    GHashTable *watched;        // Directory paths with a watch
+} trigram = { .inotify_fd = -1 };
+
+static void start_job(gboolean build);
+
+static void free_walk_entry(gpointer data) {
+    g_free(((WalkEntry *) data)->relative);
+}
+
+static void free_job(gpointer data) {
+    IndexJob *job = data;
+    g_free(job->root);
+    g_free(job->index_path);
+    g_ptr_array_unref(job->ignore);
+    if (job->mapped) {
+        g_mapped_file_unref(job->mapped);
+    }
+    g_free(job);
+}
+
+static void free_result(IndexResult *result) {
+    g_ptr_array_unref(result->dirs);
+    g_ptr_array_unref(result->dirty);
+    if (result->mapped) {
+        g_mapped_file_unref(result->mapped);
+    }
+    g_free(result);
+}
+
+// Same filters as find in files; directories are returned absolute, files relative to root
+static void walk_tree(IndexJob *job, GCancellable *cancellable, GPtrArray *dirs, GArray *files) {
+    GQueue pending = G_QUEUE_INIT;
+    gsize root_len = strlen(job->root);
+
+    g_queue_push_tail(&pending, g_strdup(job->root));
+    while (!g_queue_is_empty(&pending)) {
+        gchar *path = g_queue_pop_head(&pending);
+        GDir *dir = g_cancellable_is_cancelled(cancellable) ? NULL : g_dir_open(path, 0, NULL);
+        const gchar *name;
+
+        if (!dir) {
+            g_free(path);
+            continue;
+        }
+        g_ptr_array_add(dirs, path);
+        while ((name = g_dir_read_name(dir)) != NULL) {
+            if (find_files_is_ignored(job->ignore, name)) {
+                continue;
+            }
+            gchar *child = g_build_filename(path, name, NULL);
+            GStatBuf st;
+            if (g_lstat(child, &st) != 0) {
+                g_free(child);
+                continue;
+            }
+            if (S_ISDIR(st.st_mode)) {
+                g_queue_push_tail(&pending, child);
+                continue;
+            }
+            if (S_ISREG(st.st_mode) && st.st_size > 0 && st.st_size <= FIND_MAX_FILE_SIZE) {
+                WalkEntry entry = { g_strdup(child + root_len + 1), st.st_mtime, st.st_size };
+                g_array_append_val(files, entry);
+            }
+            g_free(child);
+        }
+        g_dir_close(dir);
+    }
+}
+
+static inline guint32 fold(guchar c) {
+    return g_ascii_tolower(c);
+}
+
+// Trigrams of ASCII-lowercased bytes; those spanning a newline are skipped since queries are single-line
+static void add_trigrams(const gchar *text, gsize length, guint8 *seen, GArray *touched) {
+    for (gsize i = 0; i + 3 <= length; i++) {
+        if (text[i] == '\n' || text[i + 1] == '\n' || text[i + 2] == '\n') {
+            continue;
+        }
+        guint32 key = fold(text[i]) << 16 | fold(text[i + 1]) << 8 | fold(text[i + 2]);
+        if (!(seen[key >> 3] & (1 << (key & 7)))) {
+            seen[key >> 3] |= 1 << (key & 7);
+            g_array_append_val(touched, key);
+        }
+    }
+}
+
+static void put_varint(GByteArray *out, guint32 value) {
+    guint8 byte;
+    while (value >= 0x80) {
+        byte = (value & 0x7F) | 0x80;
+        g_byte_array_append(out, &byte, 1);
+        value >>= 7;
+    }
+    byte = value;
+    g_byte_array_append(out, &byte, 1);
+}
+
+static void free_posting_list(gpointer data) {
+    PostingList *list = data;
+    g_byte_array_unref(list->postings);
+    g_free(list);
+}
+
+static gint compare_trigram(gconstpointer a, gconstpointer b) {
+    guint32 x = *(const guint32 *) a;
+    guint32 y = *(const guint32 *) b;
+    return x < y ? -1 : x > y;
+}
+
+static GByteArray *serialize(GArray *files, GHashTable *lists) {
+    GByteArray *out = g_byte_array_new();
+    TrigramHeader header = { TRIGRAM_MAGIC, TRIGRAM_VERSION, files->len, g_hash_table_size(lists), 0, 0, 0, 0, 0 };
+    GString *paths = g_string_new(NULL);
+    GByteArray *postings = g_byte_array_new();
+
+    g_byte_array_append(out, (const guint8 *) &header, sizeof(header));
+
+    header.files_offset = out->len;
+    for (guint i = 0; i < files->len; i++) {
+        WalkEntry *entry = &g_array_index(files, WalkEntry, i);
+        TrigramFile file = { paths->len, 0, entry->mtime, entry->size };
+        g_string_append_len(paths, entry->relative, strlen(entry->relative) + 1);
+        g_byte_array_append(out, (const guint8 *) &file, sizeof(file));
+    }
+
+    GArray *keys = g_array_sized_new(FALSE, FALSE, sizeof(guint32), g_hash_table_size(lists));
+    GHashTableIter iter;
+    gpointer key;
+    g_hash_table_iter_init(&iter, lists);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        guint32 trigram_key = GPOINTER_TO_UINT(key);
+        g_array_append_val(keys, trigram_key);
+    }
+    g_array_sort(keys, compare_trigram);
+
+    header.table_offset = out->len;
+    for (guint i = 0; i < keys->len; i++) {
+        guint32 trigram_key = g_array_index(keys, guint32, i);
+        PostingList *list = g_hash_table_lookup(lists, GUINT_TO_POINTER(trigram_key));
+        TrigramEntry entry = { trigram_key, list->count, postings->len };
+        g_byte_array_append(postings, list->postings->data, list->postings->len);
+        g_byte_array_append(out, (const guint8 *) &entry, sizeof(entry));
+    }
+    g_array_unref(keys);
+
+    header.postings_offset = out->len;
+    g_byte_array_append(out, postings->data, postings->len);
+    header.paths_offset = out->len;
+    g_byte_array_append(out, (const guint8 *) paths->str, paths->len);
+    memcpy(out->data, &header, sizeof(header));
+
+    g_byte_array_unref(postings);
+    g_string_free(paths, TRUE);
+    return out;
+}
+
+static const TrigramHeader *validate(GMappedFile *mapped) {
+    const TrigramHeader *header = (const TrigramHeader *) g_mapped_file_get_contents(mapped);
+    guint64 size = g_mapped_file_get_length(mapped);
+
+    if (size < sizeof(TrigramHeader) || memcmp(header->magic, TRIGRAM_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != TRIGRAM_VERSION ||
+        header->files_offset + (guint64) header->n_files * sizeof(TrigramFile) > header->table_offset ||
+        header->table_offset + (guint64) header->n_trigrams * sizeof(TrigramEntry) > header->postings_offset ||
+        header->postings_offset > header->paths_offset || header->paths_offset > size ||
+        (size > header->paths_offset && ((const gchar *) header)[size - 1] != '\0')) {
+        return NULL;
+    }
+
+    const TrigramFile *files = (const TrigramFile *) ((const gchar *) header + header->files_offset);
+    for (guint32 i = 0; i < header->n_files; i++) {
+        if (files[i].path >= size - header->paths_offset) {
+            return NULL;
+        }
+    }
+    return header;
+}
+
+static const TrigramFile *index_files(const TrigramHeader *header) {
+    return (const TrigramFile *) ((const gchar *) header + header->files_offset);
+}
+
+static const gchar *index_path_at(const TrigramHeader *header, guint32 offset) {
+    return (const gchar *) header + header->paths_offset + offset;
+}
+
+static GMappedFile *build_index(IndexJob *job, GArray *files, GCancellable *cancellable) {
+    GHashTable *lists = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, free_posting_list);
+    guint8 *seen = g_malloc0((1 << 24) / 8);
+    GArray *touched = g_array_new(FALSE, FALSE, sizeof(guint32));
+    GArray *indexed = g_array_new(FALSE, FALSE, sizeof(WalkEntry));
+    GMappedFile *mapped = NULL;
+
+    for (guint i = 0; i < files->len && !g_cancellable_is_cancelled(cancellable); i++) {
+        WalkEntry *entry = &g_array_index(files, WalkEntry, i);
+        gchar *path = g_build_filename(job->root, entry->relative, NULL);
+        gchar *contents;
+        gsize length;
+
+        if (g_file_get_contents(path, &contents, &length, NULL)) {
+            if (!find_files_is_binary(contents, length)) {
+                guint32 id = indexed->len;
+                g_array_append_val(indexed, *entry);
+
+                g_array_set_size(touched, 0);
+                add_trigrams(contents, length, seen, touched);
+                for (guint j = 0; j < touched->len; j++) {
+                    guint32 key = g_array_index(touched, guint32, j);
+                    PostingList *list = g_hash_table_lookup(lists, GUINT_TO_POINTER(key));
+                    if (!list) {
+                        list = g_new0(PostingList, 1);
+                        list->postings = g_byte_array_new();
+                        g_hash_table_insert(lists, GUINT_TO_POINTER(key), list);
+                    }
+                    put_varint(list->postings, id - list->last);
+                    list->last = id;
+                    list->count++;
+                    seen[key >> 3] = 0;
+                }
+            }
+            g_free(contents);
+        }
+        g_free(path);
+    }
+
+    if (!g_cancellable_is_cancelled(cancellable)) {
+        GByteArray *data = serialize(indexed, lists);
+        gchar *dir = g_path_get_dirname(job->index_path);
+        g_mkdir_with_parents(dir, 0700);
+        if (g_file_set_contents(job->index_path, (const gchar *) data->data, data->len, NULL)) {
+            mapped = g_mapped_file_new(job->index_path, FALSE, NULL);
+        }
+        g_free(dir);
+        g_byte_array_unref(data);
+    }
+
+    g_free(seen);
+    g_array_unref(touched);
+    g_array_unref(indexed);
+    g_hash_table_unref(lists);
+    return mapped;
+}
+
+// Files added or changed since the index was written
+static void check_index(IndexJob *job, GArray *files, GPtrArray *dirty) {
+    const TrigramHeader *header = validate(job->mapped);
+    const TrigramFile *indexed = index_files(header);
+    GHashTable *known = g_hash_table_new(g_str_hash, g_str_equal);
+
+    for (guint32 i = 0; i < header->n_files; i++) {
+        g_hash_table_insert(known, (gpointer) index_path_at(header, indexed[i].path), (gpointer) &indexed[i]);
+    }
+    for (guint i = 0; i < files->len; i++) {
+        WalkEntry *entry = &g_array_index(files, WalkEntry, i);
+        const TrigramFile *file = g_hash_table_lookup(known, entry->relative);
+        if (!file || file->mtime != entry->mtime || file->size != entry->size) {
+            g_ptr_array_add(dirty, g_build_filename(job->root, entry->relative, NULL));
+        }
+    }
+    g_hash_table_unref(known);
+}
+
+static void index_thread(GTask *task, gpointer source, gpointer task_data, GCancellable *cancellable) {
+    IndexJob *job = task_data;
+    IndexResult *result = g_new0(IndexResult, 1);
+    GArray *files = g_array_new(FALSE, FALSE, sizeof(WalkEntry));
+
+    g_array_set_clear_func(files, free_walk_entry);
+    result->dirs = g_ptr_array_new_with_free_func(g_free);
+    result->dirty = g_ptr_array_new_with_free_func(g_free);
+
+    walk_tree(job, cancellable, result->dirs, files);
+    if (job->mapped) {
+        check_index(job, files, result->dirty);
+    } else {
+        result->mapped = build_index(job, files, cancellable);
+    }
+    g_array_unref(files);
+
+    if (g_cancellable_is_cancelled(cancellable)) {
+        free_result(result);
+        g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_CANCELLED, "Indexing cancelled");
+        return;
+    }
+    g_task_return_pointer(task, result, (GDestroyNotify) free_result);
+}
+
+static void mark_dirty(const gchar *path) {
+    if (trigram.dirty) {
+        g_hash_table_replace(trigram.dirty, g_strdup(path), GUINT_TO_POINTER(trigram.generation));
+    }
+}
+
+static gboolean on_rebuild_timeout(gpointer data) {
+    if (trigram.busy) {
+        return G_SOURCE_CONTINUE;
+    }
+    trigram.rebuild_source = 0;
+    start_job(TRUE);
+    return G_SOURCE_REMOVE;
+}
+
+static void schedule_rebuild(void) {
+    if (!trigram.rebuild_source) {
+        trigram.rebuild_source = g_timeout_add_seconds(TRIGRAM_REBUILD_DELAY, on_rebuild_timeout, NULL);
+    }
+}
+
+static void check_rebuild(void) {
+    guint n_files = trigram.header ? trigram.header->n_files : 0;
+    if (g_hash_table_size(trigram.dirty) > MAX(TRIGRAM_REBUILD_MIN, n_files / TRIGRAM_REBUILD_FRACTION)) {
+        schedule_rebuild();
+    }
+}
+
+#ifdef __linux__
+static void add_watch(const gchar *dir) {
+    if (g_hash_table_contains(trigram.watched, dir)) {
+        return;
+    }
+    gint wd = inotify_add_watch(trigram.inotify_fd, dir,
+                                IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR);
+    if (wd >= 0) {
+        gchar *path = g_strdup(dir);
+        g_hash_table_replace(trigram.watches, GINT_TO_POINTER(wd), path);
+        g_hash_table_add(trigram.watched, path);
+    } else {
+        g_debug("Trigram index: cannot watch %s; changes there are picked up at the next check", dir);
+    }
+}
+
+static gboolean on_inotify_ready(gint fd, GIOCondition condition, gpointer data) {
+    gchar buffer[16 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+    gssize length = read(fd, buffer, sizeof(buffer));
+
+    for (gssize offset = 0; offset < length;) {
+        const struct inotify_event *event = (const struct inotify_event *) (buffer + offset);
+        const gchar *dir = g_hash_table_lookup(trigram.watches, GINT_TO_POINTER(event->wd));
+        offset += sizeof(struct inotify_event) + event->len;
+
+        if (event->mask & IN_Q_OVERFLOW) {
+            schedule_rebuild();
+        } else if (event->mask & IN_IGNORED) {
+            if (dir) {
+                g_hash_table_remove(trigram.watched, dir);
+            }
+            g_hash_table_remove(trigram.watches, GINT_TO_POINTER(event->wd));
+        } else if (dir && event->len > 0 && !find_files_is_ignored(trigram.ignore, event->name)) {
+            gchar *path = g_build_filename(dir, event->name, NULL);
+            // A new directory may already hold files; a rebuild finds them and adds its watch
+            if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO))) {
+                add_watch(path);
+                schedule_rebuild();
+            } else if (!(event->mask & IN_ISDIR)) {
+                mark_dirty(path);
+            }
+            g_free(path);
+        }
+    }
+    check_rebuild();
+    return G_SOURCE_CONTINUE;
+}
+#endif
+
+static void watch_dirs(GPtrArray *dirs) {
+#ifdef __linux__
+    if (trigram.inotify_fd < 0) {
+        trigram.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (trigram.inotify_fd < 0) {
+            return;
+        }
+        trigram.watches = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+        trigram.watched = g_hash_table_new(g_str_hash, g_str_equal);
+        trigram.inotify_source = g_unix_fd_add(trigram.inotify_fd, G_IO_IN, on_inotify_ready, NULL);
+    }
+    for (guint i = 0; i < dirs->len; i++) {
+        add_watch(g_ptr_array_index(dirs, i));
+    }
+#endif
+}
+
+static void stop_watching(void) {
+#ifdef __linux__
+    if (trigram.inotify_fd >= 0) {
+        g_source_remove(trigram.inotify_source);
+        close(trigram.inotify_fd);
+        g_hash_table_unref(trigram.watched);
+        g_hash_table_unref(trigram.watches);
+        trigram.inotify_fd = -1;
+        trigram.inotify_source = 0;
+        trigram.watches = NULL;
+        trigram.watched = NULL;
+    }
+#endif
+}
+
+static void set_index(GMappedFile *mapped) {
+    if (trigram.mapped) {
+        g_mapped_file_unref(trigram.mapped);
+    }
+    trigram.mapped = mapped;
+    trigram.header = mapped ? validate(mapped) : NULL;
+}
+
+static void on_job_done(GObject *source, GAsyncResult *res, gpointer data) {
+    IndexJob *job = g_task_get_task_data(G_TASK(res));
+    IndexResult *result = g_task_propagate_pointer(G_TASK(res), NULL);
+    GHashTableIter iter;
+    gpointer generation;
+
+    if (!result) {
+        return;
+    }
+    trigram.busy = FALSE;
+    g_clear_object(&trigram.cancellable);
+
+    if (result->mapped) {
+        set_index(g_mapped_file_ref(result->mapped));
+        // Changes seen before the walk started are in the new index
+        g_hash_table_iter_init(&iter, trigram.dirty);
+        while (g_hash_table_iter_next(&iter, NULL, &generation)) {
+            if (GPOINTER_TO_UINT(generation) < job->generation) {
+                g_hash_table_iter_remove(&iter);
+            }
+        }
+    }
+    for (guint i = 0; i < result->dirty->len; i++) {
+        mark_dirty(g_ptr_array_index(result->dirty, i));
+    }
+
+    // A rebuild may have found directories created since the last walk
+    watch_dirs(result->dirs);
+    free_result(result);
+    check_rebuild();
+}
+
+static void start_job(gboolean build) {
+    IndexJob *job = g_new0(IndexJob, 1);
+
+    job->root = g_strdup(trigram.root);
+    job->index_path = g_strdup(trigram.index_path);
+    job->ignore = g_ptr_array_ref(trigram.ignore);
+    job->mapped = !build && trigram.mapped ? g_mapped_file_ref(trigram.mapped) : NULL;
+    job->generation = ++trigram.generation;
+    trigram.busy = TRUE;
+    trigram.cancellable = g_cancellable_new();
+
+    GTask *task = g_task_new(NULL, trigram.cancellable, on_job_done, NULL);
+    g_task_set_task_data(task, job, free_job);
+    g_task_run_in_thread(task, index_thread);
+    g_object_unref(task);
+}
+
+static void reset(void) {
+    if (trigram.cancellable) {
+        g_cancellable_cancel(trigram.cancellable);
+        g_clear_object(&trigram.cancellable);
+    }
+    if (trigram.rebuild_source) {
+        g_source_remove(trigram.rebuild_source);
+        trigram.rebuild_source = 0;
+    }
+    stop_watching();
+    set_index(NULL);
+    g_clear_pointer(&trigram.dirty, g_hash_table_unref);
+    g_clear_pointer(&trigram.ignore, g_ptr_array_unref);
+    g_clear_pointer(&trigram.root, g_free);
+    g_clear_pointer(&trigram.index_path, g_free);
+    trigram.busy = FALSE;
+}
+
+// Loads the saved index for root, or builds one in the background, and keeps it current
+void trigram_index_request(const gchar *root) {
+    if (g_strcmp0(trigram.root, root) == 0) {
+        return;
+    }
+    reset();
+
+    gchar *key = g_compute_checksum_for_string(G_CHECKSUM_SHA1, root, -1);
+    gchar *name = g_strconcat(key, ".idx", NULL);
+    trigram.root = g_strdup(root);
+    trigram.index_path = g_build_filename(g_get_user_cache_dir(), "codepad", "trigram", name, NULL);
+    trigram.ignore = find_files_load_ignores(root);
+    trigram.dirty = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    g_free(name);
+    g_free(key);
+
+    GMappedFile *mapped = g_mapped_file_new(trigram.index_path, FALSE, NULL);
+    if (mapped && validate(mapped)) {
+        set_index(mapped);
+        start_job(FALSE);
+    } else {
+        if (mapped) {
+            g_mapped_file_unref(mapped);
+        }
+        start_job(TRUE);
+    }
+}
+
+static const TrigramEntry *lookup(guint32 key) {
+    const TrigramEntry *table = (const TrigramEntry *) ((const gchar *) trigram.header + trigram.header->table_offset);
+    guint32 low = 0, high = trigram.header->n_trigrams;
+
+    while (low < high) {
+        guint32 mid = low + (high - low) / 2;
+        if (table[mid].trigram < key) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low < trigram.header->n_trigrams && table[low].trigram == key ? &table[low] : NULL;
+}
+
+static void decode(const TrigramEntry *entry, GArray *ids) {
+    const guint8 *p = (const guint8 *) trigram.header + trigram.header->postings_offset + entry->postings;
+    const guint8 *end = (const guint8 *) trigram.header + trigram.header->paths_offset;
+    guint32 id = 0;
+
+    g_array_set_size(ids, 0);
+    for (guint32 i = 0; i < entry->count && p < end; i++) {
+        guint32 delta = 0;
+        for (guint shift = 0; p < end && shift < 35; shift += 7) {
+            delta |= (guint32) (*p & 0x7F) << shift;
+            if (!(*p++ & 0x80)) {
+                break;
+            }
+        }
+        id += delta;
+        g_array_append_val(ids, id);
+    }
+}
+
+static gint compare_entry_count(gconstpointer a, gconstpointer b) {
+    const TrigramEntry *x = *(const TrigramEntry **) a;
+    const TrigramEntry *y = *(const TrigramEntry **) b;
+    return x->count < y->count ? -1 : x->count > y->count;
+}
+
+// Files that may contain query (indexed hits plus everything changed since), or NULL when the index
+// cannot answer: a different root, no index yet, or a query shorter than a trigram
+GPtrArray *trigram_index_candidates(const gchar *root, const gchar *query) {
+    gsize length = strlen(query);
+
+    if (g_strcmp0(trigram.root, root) != 0 || !trigram.header || length < 3) {
+        return NULL;
+    }
+
+    GPtrArray *entries = g_ptr_array_new();
+    gboolean missing = FALSE;
+    for (gsize i = 0; i + 3 <= length && !missing; i++) {
+        guint32 key = fold(query[i]) << 16 | fold(query[i + 1]) << 8 | fold(query[i + 2]);
+        const TrigramEntry *entry = lookup(key);
+        if (!entry) {
+            missing = TRUE;
+        } else if (!g_ptr_array_find(entries, entry, NULL)) {
+            g_ptr_array_add(entries, (gpointer) entry);
+        }
+    }
+
+    // Intersect starting from the rarest trigram
+    GArray *ids = g_array_new(FALSE, FALSE, sizeof(guint32));
+    GArray *other = g_array_new(FALSE, FALSE, sizeof(guint32));
+    if (!missing) {
+        g_ptr_array_sort(entries, compare_entry_count);
+        decode(g_ptr_array_index(entries, 0), ids);
+        for (guint i = 1; i < entries->len && ids->len > 0; i++) {
+            decode(g_ptr_array_index(entries, i), other);
+            guint kept = 0;
+            for (guint a = 0, b = 0; a < ids->len && b < other->len;) {
+                guint32 x = g_array_index(ids, guint32, a), y = g_array_index(other, guint32, b);
+                if (x == y) {
+                    g_array_index(ids, guint32, kept++) = x;
+                    a++;
+                    b++;
+                } else if (x < y) {
+                    a++;
+                } else {
+                    b++;
+                }
+            }
+            g_array_set_size(ids, kept);
+        }
+    }
+
+    GPtrArray *candidates = g_ptr_array_new_with_free_func(g_free);
+    GHashTable *seen = g_hash_table_new(g_str_hash, g_str_equal);
+    const TrigramFile *files = index_files(trigram.header);
+    for (guint i = 0; i < ids->len; i++) {
+        guint32 id = g_array_index(ids, guint32, i);
+        if (id < trigram.header->n_files) {
+            gchar *path = g_build_filename(root, index_path_at(trigram.header, files[id].path), NULL);
+            g_ptr_array_add(candidates, path);
+            g_hash_table_add(seen, path);
+        }
+    }
+    GHashTableIter iter;
+    gpointer path;
+    g_hash_table_iter_init(&iter, trigram.dirty);
+    while (g_hash_table_iter_next(&iter, &path, NULL)) {
+        if (!g_hash_table_contains(seen, path)) {
+            g_ptr_array_add(candidates, g_strdup(path));
+        }
+    }
+
+    g_hash_table_unref(seen);
+    g_array_unref(ids);
+    g_array_unref(other);
+    g_ptr_array_unref(entries);
+    return candidates;
+}
+
+const gchar *trigram_index_status(const gchar *root) {
+    if (g_strcmp0(trigram.root, root) != 0) {
+        return "no index";
+    }
+    if (!trigram.header) {
+        return "indexing…";
+    }
+    return trigram.busy ? "index, updating" : "index";
+}
@@ -18,63 +18,73 @@ void setup_ui(void) {
 
     // Create search bar
     editor->search_bar = gtk_search_bar_new();
+    GtkWidget *search_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 6);
     editor->search_entry = gtk_search_entry_new();
     gtk_widget_set_hexpand(editor->search_entry, TRUE);
-    gtk_container_add(GTK_CONTAINER(editor->search_bar), editor->search_entry);
+    gtk_box_pack_start(GTK_BOX(search_box), editor->search_entry, TRUE, TRUE, 0);
+
+    editor->search_label = gtk_label_new("");
+    gtk_widget_set_size_request(editor->search_label, 100, -1);
+    gtk_box_pack_start(GTK_BOX(search_box), editor->search_label, FALSE, FALSE, 0);
+
+    editor->match_case_button = gtk_toggle_button_new_with_label("Aa");
+    gtk_widget_set_tooltip_text(editor->match_case_button, "Match case");
+    gtk_box_pack_start(GTK_BOX(search_box), editor->match_case_button, FALSE, FALSE, 0);
+
+    editor->regex_button = gtk_toggle_button_new_with_label(".*");
+    gtk_widget_set_tooltip_text(editor->regex_button, "Regular expression");
+    gtk_box_pack_start(GTK_BOX(search_box), editor->regex_button, FALSE, FALSE, 0);
+
+    GtkWidget *previous_button = gtk_button_new_from_icon_name("go-up-symbolic", GTK_ICON_SIZE_BUTTON);
+    gtk_widget_set_tooltip_text(previous_button, "Previous match (Shift+F3)");
+    g_signal_connect(previous_button, "clicked", G_CALLBACK(on_find_previous), NULL);
+    gtk_box_pack_start(GTK_BOX(search_box), previous_button, FALSE, FALSE, 0);
+
+    GtkWidget *next_button = gtk_button_new_from_icon_name("go-down-symbolic", GTK_ICON_SIZE_BUTTON);
+    gtk_widget_set_tooltip_text(next_button, "Next match (F3)");
+    g_signal_connect(next_button, "clicked", G_CALLBACK(on_find_next), NULL);
+    gtk_box_pack_start(GTK_BOX(search_box), next_button, FALSE, FALSE, 0);
+
+    // Replace row; \1 etc. refer to capture groups in regex mode
+    GtkWidget *replace_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 6);
+    editor->replace_entry = gtk_entry_new();
+    gtk_entry_set_placeholder_text(GTK_ENTRY(editor->replace_entry), "Replace with");
+    gtk_box_pack_start(GTK_BOX(replace_box), editor->replace_entry, TRUE, TRUE, 0);
+
+    GtkWidget *replace_button = gtk_button_new_with_label("Replace All");
+    g_signal_connect(replace_button, "clicked", G_CALLBACK(on_replace_all), NULL);
+    gtk_box_pack_start(GTK_BOX(replace_box), replace_button, FALSE, FALSE, 0);
+
+    GtkWidget *search_rows = gtk_box_new(GTK_ORIENTATION_VERTICAL, 6);
+    gtk_box_pack_start(GTK_BOX(search_rows), search_box, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(search_rows), replace_box, FALSE, FALSE, 0);
+    gtk_container_add(GTK_CONTAINER(editor->search_bar), search_rows);
+    gtk_search_bar_connect_entry(GTK_SEARCH_BAR(editor->search_bar), GTK_ENTRY(editor->search_entry));
     gtk_box_pack_start(GTK_BOX(main_vbox), editor->search_bar, FALSE, FALSE, 0);
 
+    // Side panel (find in files) next to the editor and terminal
+    editor->side_paned = gtk_paned_new(GTK_ORIENTATION_HORIZONTAL);
+    gtk_box_pack_start(GTK_BOX(main_vbox), editor->side_paned, TRUE, TRUE, 0);
+
     // Create paned widget for editor and terminal
     editor->paned = gtk_paned_new(GTK_ORIENTATION_VERTICAL);
-    gtk_box_pack_start(GTK_BOX(main_vbox), editor->paned, TRUE, TRUE, 0);
+    gtk_paned_pack2(GTK_PANED(editor->side_paned), editor->paned, TRUE, FALSE);
 
     // Status bar
     editor->status_bar = gtk_statusbar_new();
     gtk_box_pack_start(GTK_BOX(main_vbox), editor->status_bar, FALSE, FALSE, 0);
+
+    // Load progress, only shown while a file is streaming in
+    editor->load_cancel_button = gtk_button_new_from_icon_name("process-stop", GTK_ICON_SIZE_BUTTON);
+    gtk_widget_set_tooltip_text(editor->load_cancel_button, "Cancel loading");
+    gtk_widget_set_no_show_all(editor->load_cancel_button, TRUE);
+    gtk_box_pack_end(GTK_BOX(editor->status_bar), editor->load_cancel_button, FALSE, FALSE, 0);
+
+    editor->load_progress = gtk_progress_bar_new();
+    gtk_progress_bar_set_show_text(GTK_PROGRESS_BAR(editor->load_progress), TRUE);
+    gtk_widget_set_valign(editor->load_progress, GTK_ALIGN_CENTER);
+    gtk_widget_set_size_request(editor->load_progress, 200, -1);
+    gtk_widget_set_no_show_all(editor->load_progress, TRUE);
+    gtk_box_pack_end(GTK_BOX(editor->status_bar), editor->load_progress, FALSE, FALSE, 0);
 }
 
-void apply_theme(void) {
-    GtkCssProvider *provider = gtk_css_provider_new();
-    gchar *css;
-
-    if (editor->dark_mode) {
-        css = g_strdup_printf(
-            "window { background-color: #1e1e1e; color: #d4d4d4; }"
-            "textview { background-color: #1e1e1e; color: #d4d4d4; font-family: monospace; font-size: %dpt; padding: 12px; }"
-            ".line-numbers { background-color: #252526; color: #858585; font-family: monospace; font-size: %dpt; padding: 12px 8px; border-right: 1px solid #3c3c3c; }"
-            "headerbar { background: #3c3c3c; border-bottom: 1px solid #1e1e1e; }"
-            "headerbar button { background: #404040; border: 1px solid #555; color: #d4d4d4; }"
-            "statusbar { background-color: #007acc; color: white; }"
-            ".terminal-header { background-color: #2d2d30; border-bottom: 1px solid #555; }",
-            editor->zoom_level, editor->zoom_level);
-
-        if (editor->terminal) {
-            GdkRGBA bg_color = {0.12, 0.12, 0.12, 1.0};
-            GdkRGBA fg_color = {0.83, 0.83, 0.83, 1.0};
-            vte_terminal_set_color_background(VTE_TERMINAL(editor->terminal), &bg_color);
-            vte_terminal_set_color_foreground(VTE_TERMINAL(editor->terminal), &fg_color);
-        }
-    } else {
-        css = g_strdup_printf(
-            "window { background-color: #ffffff; color: #333333; }"
-            "textview { background-color: #ffffff; color: #333333; font-family: monospace; font-size: %dpt; padding: 12px; }"
-            ".line-numbers { background-color: #f8f8f8; color: #999999; font-family: monospace; font-size: %dpt; padding: 12px 8px; border-right: 1px solid #e0e0e0; }"
-            "headerbar { background: #f0f0f0; border-bottom: 1px solid #d0d0d0; }"
-            "headerbar button { background: #ffffff; border: 1px solid #ccc; color: #333; }"
-            "statusbar { background-color: #0078d4; color: white; }"
-            ".terminal-header { background-color: #e0e0e0; border-bottom: 1px solid #ccc; }",
-            editor->zoom_level, editor->zoom_level);
-
-        if (editor->terminal) {
-            GdkRGBA bg_color = {1.0, 1.0, 1.0, 1.0};
-            GdkRGBA fg_color = {0.2, 0.2, 0.2, 1.0};
-            vte_terminal_set_color_background(VTE_TERMINAL(editor->terminal), &bg_color);
-            vte_terminal_set_color_foreground(VTE_TERMINAL(editor->terminal), &fg_color);
-        }
-    }
-
-    gtk_css_provider_load_from_data(provider, css, -1, NULL);
-    gtk_style_context_add_provider_for_screen(gdk_screen_get_default(),
-                                              GTK_STYLE_PROVIDER(provider), GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
-    g_object_unref(provider);
-    g_free(css);
-}
\ No newline at end of file
@@ -0,0 +1,469 @@
+#include "header.h"
+
+#define UNDO_BLOCK_SIZE (64 * 1024)     // Arena block for delta records and their inline text
+#define UNDO_INLINE_MAX (4 * 1024)      // Longer text is kept as a slice of the document instead of a copy
+
+typedef enum {
+    UNDO_INSERT,
+    UNDO_DELETE
+} UndoKind;
+
+// Deltas are appended to the newest block and only ever released from either end of the log
+typedef struct {
+    gsize used;
+    gsize capacity;
+    guint live;                 // Deltas still stored here
+    gchar data[];
+} UndoBlock;
+
+typedef struct {
+    UndoBlock *block;
+    gsize offset;               // Char offset of the change
+    gsize chars;
+    gsize bytes;
+    DocSnapshot *slice;         // Long text shared with the document; NULL when the text follows inline
+    guint8 kind;
+    gboolean group_start;       // First delta of a user action; undo and redo stop here
+    gboolean typing;            // A single typed or erased character that later keystrokes may extend
+    gchar text[];
+} UndoDelta;
+
+struct _UndoHistory {
+    GQueue blocks;
+    GPtrArray *deltas;          // In recording order
+    guint first;                // Deltas below this were evicted and wait for compaction
+    guint position;             // Deltas below this are applied; the rest can be redone
+    gsize used;                 // Arena blocks plus deleted text held in slices
+};
+
+static struct {
+    UndoHistory *history;       // Where edits to the shown tab are recorded; NULL while tabs are swapped
+    GPtrArray *histories;       // Every tab's history, for the shared memory budget
+    gboolean in_action;
+    gboolean action_recorded;   // The current user action has its first delta
+    gboolean applying;
+    UndoHistory *reloading;     // Waiting for the text of a reload to complete its action
+    gboolean reload_recorded;   // The reload's action already holds the deletion of the old text
+} undo;
+
+UndoHistory *undo_history_new(void) {
+    UndoHistory *history = g_new0(UndoHistory, 1);
+    g_queue_init(&history->blocks);
+    history->deltas = g_ptr_array_new();
+    g_ptr_array_add(undo.histories, history);
+    return history;
+}
+
+// Memory a delta holds beyond its arena record; inserted text in a slice is still in the document
+static gsize slice_cost(UndoDelta *delta) {
+    return delta->slice && delta->kind == UNDO_DELETE ? delta->bytes : 0;
+}
+
+static void release_delta(UndoHistory *history, UndoDelta *delta) {
+    if (delta->slice) {
+        history->used -= slice_cost(delta);
+        doc_snapshot_unref(delta->slice);
+    }
+    delta->block->live--;
+}
+
+static void free_block(UndoHistory *history, UndoBlock *block) {
+    history->used -= block->capacity;
+    g_free(block);
+}
+
+void undo_history_free(UndoHistory *history) {
+    for (guint i = history->first; i < history->deltas->len; i++) {
+        UndoDelta *delta = g_ptr_array_index(history->deltas, i);
+        if (delta->slice) {
+            doc_snapshot_unref(delta->slice);
+        }
+    }
+    g_queue_clear_full(&history->blocks, g_free);
+    g_ptr_array_free(history->deltas, TRUE);
+    g_ptr_array_remove(undo.histories, history);
+    if (undo.history == history) {
+        undo.history = NULL;
+    }
+    if (undo.reloading == history) {
+        undo.reloading = NULL;
+    }
+    g_free(history);
+}
+
+static gsize record_size(gsize inline_bytes) {
+    return (G_STRUCT_OFFSET(UndoDelta, text) + inline_bytes + 7) & ~(gsize) 7;
+}
+
+static UndoDelta *alloc_delta(UndoHistory *history, gsize inline_bytes) {
+    UndoBlock *block = g_queue_peek_tail(&history->blocks);
+    gsize size = record_size(inline_bytes);
+
+    if (!block || block->capacity - block->used < size) {
+        gsize capacity = MAX(UNDO_BLOCK_SIZE, size);
+        block = g_malloc(sizeof(UndoBlock) + capacity);
+        block->used = 0;
+        block->capacity = capacity;
+        block->live = 0;
+        g_queue_push_tail(&history->blocks, block);
+        history->used += capacity;
+    }
+
+    UndoDelta *delta = (UndoDelta *) (block->data + block->used);
+    block->used += size;
+    block->live++;
+    memset(delta, 0, sizeof(UndoDelta));
+    delta->block = block;
+    g_ptr_array_add(history->deltas, delta);
+    return delta;
+}
+
+// Grows the newest delta in place when its block has room for more inline text
+static gboolean grow_delta(UndoDelta *delta, gsize bytes) {
+    UndoBlock *block = delta->block;
+    gsize old_size = record_size(delta->bytes);
+    gsize new_size = record_size(delta->bytes + bytes);
+
+    if ((gchar *) delta + old_size != block->data + block->used || block->capacity - block->used < new_size - old_size) {
+        return FALSE;
+    }
+    block->used += new_size - old_size;
+    return TRUE;
+}
+
+// New edits after an undo make the undone deltas unreachable; they sit at the end of the arena
+static void drop_redo(UndoHistory *history) {
+    while (history->deltas->len > history->position) {
+        UndoDelta *delta = g_ptr_array_index(history->deltas, history->deltas->len - 1);
+        UndoBlock *block = delta->block;
+
+        release_delta(history, delta);
+        block->used = (gchar *) delta - block->data;
+        if (block->live == 0 && history->blocks.length > 1) {
+            free_block(history, g_queue_pop_tail(&history->blocks));
+        }
+        g_ptr_array_set_size(history->deltas, history->deltas->len - 1);
+    }
+}
+
+// End of the oldest user action, or 0 when only the latest applied one is left
+static guint oldest_group_end(UndoHistory *history) {
+    for (guint end = history->first + 1; end < history->position; end++) {
+        if (((UndoDelta *) g_ptr_array_index(history->deltas, end))->group_start) {
+            return end;
+        }
+    }
+    return 0;
+}
+
+static void evict_oldest(UndoHistory *history, guint end) {
+    for (guint i = history->first; i < end; i++) {
+        release_delta(history, g_ptr_array_index(history->deltas, i));
+    }
+    history->first = end;
+    while (history->blocks.length > 1 && ((UndoBlock *) g_queue_peek_head(&history->blocks))->live == 0) {
+        free_block(history, g_queue_pop_head(&history->blocks));
+    }
+
+    // Compact the index once the evicted prefix dominates it
+    if (history->first > history->deltas->len / 2) {
+        g_ptr_array_remove_range(history->deltas, 0, history->first);
+        history->position -= history->first;
+        history->first = 0;
+    }
+}
+
+gsize undo_memory_used(void) {
+    gsize total = 0;
+
+    for (guint i = 0; i < undo.histories->len; i++) {
+        total += ((UndoHistory *) g_ptr_array_index(undo.histories, i))->used;
+    }
+    return total;
+}
+
+// Oldest-first across all tabs, taking from the largest history that can spare an action
+static void enforce_budget(void) {
+    while (undo_memory_used() > editor->undo_budget) {
+        UndoHistory *largest = NULL;
+        guint largest_end = 0;
+
+        for (guint i = 0; i < undo.histories->len; i++) {
+            UndoHistory *history = g_ptr_array_index(undo.histories, i);
+            guint end;
+            if ((!largest || history->used > largest->used) && (end = oldest_group_end(history))) {
+                largest = history;
+                largest_end = end;
+            }
+        }
+        if (!largest) {
+            return;
+        }
+        evict_oldest(largest, largest_end);
+    }
+}
+
+static gboolean recording(void) {
+    return undo.history && undo.in_action && !undo.applying && !editor->loading;
+}
+
+// The newest delta, when the current keystroke may extend it
+static UndoDelta *typing_tail(UndoKind kind, gsize chars) {
+    UndoHistory *history = undo.history;
+
+    if (undo.action_recorded || chars != 1 || history->position != history->deltas->len ||
+        history->position <= history->first) {
+        return NULL;
+    }
+    UndoDelta *last = g_ptr_array_index(history->deltas, history->position - 1);
+    return last->typing && last->kind == kind ? last : NULL;
+}
+
+static UndoDelta *record(UndoKind kind, gsize offset, gsize chars, const gchar *text, gsize bytes, DocSnapshot *slice) {
+    UndoHistory *history = undo.history;
+
+    drop_redo(history);
+    UndoDelta *delta = alloc_delta(history, slice ? 0 : bytes);
+    delta->kind = kind;
+    delta->offset = offset;
+    delta->chars = chars;
+    delta->bytes = bytes;
+    delta->slice = slice;
+    delta->group_start = !undo.action_recorded;
+    delta->typing = !slice && chars == 1 && !undo.action_recorded && text[0] != '\n';
+    if (!slice) {
+        memcpy(delta->text, text, bytes);
+    }
+    history->used += slice_cost(delta);
+    history->position = history->deltas->len;
+    undo.action_recorded = TRUE;
+    return delta;
+}
+
+// Runs after the buffer and the document have taken the text; location is now its end
+static void on_undo_insert_text(GtkTextBuffer *buffer, GtkTextIter *location, gchar *text, gint len, gpointer data) {
+    if (!recording() || len == 0) {
+        return;
+    }
+    gsize chars = g_utf8_strlen(text, len);
+    gsize offset = gtk_text_iter_get_offset(location) - chars;
+    UndoDelta *last = typing_tail(UNDO_INSERT, chars);
+
+    // Consecutive typing becomes one entry, up to a line break
+    if (last && text[0] != '\n' && last->offset + last->chars == offset && grow_delta(last, len)) {
+        memcpy(last->text + last->bytes, text, len);
+        last->chars++;
+        last->bytes += len;
+        undo.action_recorded = TRUE;
+        return;
+    }
+
+    DocSnapshot *slice = NULL;
+    if ((gsize) len > UNDO_INLINE_MAX) {
+        DocSnapshot *snapshot = document_snapshot(editor->document);
+        slice = doc_snapshot_slice(snapshot, offset, offset + chars);
+        doc_snapshot_unref(snapshot);
+    }
+    record(UNDO_INSERT, offset, chars, text, len, slice);
+    enforce_budget();
+}
+
+// Runs before the document drops the text, so long deletions can share its chunks
+static void on_undo_delete_range(GtkTextBuffer *buffer, GtkTextIter *start, GtkTextIter *end, gpointer data) {
+    if (!recording() || gtk_text_iter_equal(start, end)) {
+        return;
+    }
+    gsize offset = gtk_text_iter_get_offset(start);
+    gsize chars = gtk_text_iter_get_offset(end) - offset;
+    DocSnapshot *slice = NULL;
+    gchar *text = NULL;
+    gsize bytes;
+
+    // Four bytes per char bounds the UTF-8 length without reading the text
+    if (chars * 4 > UNDO_INLINE_MAX) {
+        DocSnapshot *snapshot = document_snapshot(editor->document);
+        slice = doc_snapshot_slice(snapshot, offset, offset + chars);
+        doc_snapshot_unref(snapshot);
+        bytes = doc_snapshot_get_length(slice);
+    } else {
+        text = gtk_text_buffer_get_slice(buffer, start, end, TRUE);
+        bytes = strlen(text);
+    }
+
+    // Backspace extends the run to the left, Delete to the right
+    UndoDelta *last = slice ? NULL : typing_tail(UNDO_DELETE, chars);
+    if (last && text[0] != '\n' && (offset + 1 == last->offset || offset == last->offset) && grow_delta(last, bytes)) {
+        if (offset + 1 == last->offset) {
+            memmove(last->text + bytes, last->text, last->bytes);
+            memcpy(last->text, text, bytes);
+            last->offset = offset;
+        } else {
+            memcpy(last->text + last->bytes, text, bytes);
+        }
+        last->chars++;
+        last->bytes += bytes;
+        undo.action_recorded = TRUE;
+    } else {
+        record(UNDO_DELETE, offset, chars, text, bytes, slice);
+        enforce_budget();
+    }
+    g_free(text);
+}
+
+static void on_undo_begin_action(GtkTextBuffer *buffer, gpointer data) {
+    undo.in_action = TRUE;
+    undo.action_recorded = FALSE;
+}
+
+static void on_undo_end_action(GtkTextBuffer *buffer, gpointer data) {
+    undo.in_action = FALSE;
+}
+
+static void insert_delta_text(UndoDelta *delta) {
+    GtkTextIter iter;
+
+    gtk_text_buffer_get_iter_at_offset(editor->buffer, &iter, (gint) delta->offset);
+    if (!delta->slice) {
+        gtk_text_buffer_insert(editor->buffer, &iter, delta->text, delta->bytes);
+        return;
+    }
+    // Piece by piece; the iter is revalidated to the end of each insertion
+    for (guint i = 0; i < doc_snapshot_get_n_pieces(delta->slice); i++) {
+        gsize length;
+        const gchar *piece = doc_snapshot_get_piece(delta->slice, i, &length);
+        gtk_text_buffer_insert(editor->buffer, &iter, piece, length);
+    }
+}
+
+static void delete_delta_text(UndoDelta *delta) {
+    GtkTextIter start, end;
+
+    gtk_text_buffer_get_iter_at_offset(editor->buffer, &start, (gint) delta->offset);
+    gtk_text_buffer_get_iter_at_offset(editor->buffer, &end, (gint) (delta->offset + delta->chars));
+    gtk_text_buffer_delete(editor->buffer, &start, &end);
+}
+
+static void show_change(gsize offset) {
+    GtkTextIter iter;
+
+    gtk_text_buffer_get_iter_at_offset(editor->buffer, &iter, (gint) offset);
+    gtk_text_buffer_place_cursor(editor->buffer, &iter);
+    gtk_text_view_scroll_mark_onscreen(GTK_TEXT_VIEW(editor->text_view), gtk_text_buffer_get_insert(editor->buffer));
+}
+
+// Reverts the last user action
+void undo_last(void) {
+    UndoHistory *history = undo.history;
+    UndoDelta *delta = NULL;
+
+    if (!history || history->position <= history->first || editor->loading || editor->unloaded ||
+        viewer_is_active()) {
+        return;
+    }
+    undo.applying = TRUE;
+    do {
+        delta = g_ptr_array_index(history->deltas, --history->position);
+        if (delta->kind == UNDO_INSERT) {
+            delete_delta_text(delta);
+        } else {
+            insert_delta_text(delta);
+        }
+    } while (!delta->group_start && history->position > history->first);
+    undo.applying = FALSE;
+    show_change(delta->kind == UNDO_DELETE ? delta->offset + delta->chars : delta->offset);
+}
+
+// Applies the next undone user action again
+void redo_last(void) {
+    UndoHistory *history = undo.history;
+    UndoDelta *delta = NULL;
+
+    if (!history || history->position >= history->deltas->len || editor->loading || editor->unloaded ||
+        viewer_is_active()) {
+        return;
+    }
+    undo.applying = TRUE;
+    do {
+        delta = g_ptr_array_index(history->deltas, history->position++);
+        if (delta->kind == UNDO_INSERT) {
+            insert_delta_text(delta);
+        } else {
+            delete_delta_text(delta);
+        }
+    } while (history->position < history->deltas->len &&
+             !((UndoDelta *) g_ptr_array_index(history->deltas, history->position))->group_start);
+    undo.applying = FALSE;
+    show_change(delta->kind == UNDO_INSERT ? delta->offset + delta->chars : delta->offset);
+}
+
+// Makes history the one edits are recorded into and undone from
+void undo_set_history(UndoHistory *history) {
+    undo.history = history;
+}
+
+// Whether the history holds anything to undo or redo
+gboolean undo_history_is_empty(UndoHistory *history) {
+    return history->first == history->deltas->len;
+}
+
+// A new document starts with no history
+void undo_clear(void) {
+    if (!undo.history) {
+        return;
+    }
+    undo.history->position = undo.history->first;
+    drop_redo(undo.history);
+}
+
+// Reading the shown file again is one user action: the old text is deleted here, where it is recorded as a
+// slice of the document, and undo_end_reload() adds the text that replaces it
+void undo_begin_reload(void) {
+    GtkTextIter start, end;
+
+    if (!undo.history) {
+        return;
+    }
+    gtk_text_buffer_get_bounds(editor->buffer, &start, &end);
+    gtk_text_buffer_begin_user_action(editor->buffer);
+    gtk_text_buffer_delete(editor->buffer, &start, &end);
+    gtk_text_buffer_end_user_action(editor->buffer);
+    undo.reloading = undo.history;
+    undo.reload_recorded = undo.action_recorded;
+}
+
+// Runs when any load ends; a reload that did not complete takes its deletion back out of the history
+void undo_end_reload(gboolean loaded) {
+    UndoHistory *history = undo.reloading;
+
+    undo.reloading = NULL;
+    if (!history || history != undo.history) {
+        return;
+    }
+    if (!loaded) {
+        if (undo.reload_recorded) {
+            history->position--;
+            drop_redo(history);
+        }
+        return;
+    }
+
+    DocSnapshot *snapshot = document_snapshot(editor->document);
+    gsize chars = doc_snapshot_get_char_count(snapshot);
+    if (chars > 0) {
+        undo.action_recorded = undo.reload_recorded;
+        record(UNDO_INSERT, 0, chars, NULL, doc_snapshot_get_length(snapshot),
+               doc_snapshot_slice(snapshot, 0, chars));
+        undo.action_recorded = FALSE;
+        enforce_budget();
+    }
+    doc_snapshot_unref(snapshot);
+}
+
+// Must run before document_attach(): deletions are read from the document before it drops them
+void undo_attach(GtkTextBuffer *buffer) {
+    undo.histories = g_ptr_array_new();
+    g_signal_connect(buffer, "delete-range", G_CALLBACK(on_undo_delete_range), NULL);
+    g_signal_connect_after(buffer, "insert-text", G_CALLBACK(on_undo_insert_text), NULL);
+    g_signal_connect(buffer, "begin-user-action", G_CALLBACK(on_undo_begin_action), NULL);
+    g_signal_connect(buffer, "end-user-action", G_CALLBACK(on_undo_end_action), NULL);
+}
@@ -0,0 +1,683 @@
+#include "header.h"
+
+#define VIEWER_INDEX_STRIDE 64            // Lines between stored line-start checkpoints
+#define VIEWER_PUBLISH_LINES (1 << 16)    // Lines indexed between publishes to the main thread
+#define VIEWER_MAX_LINE_BYTES (64 * 1024) // Longer lines are cut when paged in
+#define VIEWER_SEARCH_BLOCK (16 * 1024 * 1024)
+
+typedef struct {
+    gchar *filename;
+    GMappedFile *mapped;
+    const gchar *data;
+    gsize size;
+
+    // Line index, filled in by the indexer thread
+    GMutex lock;
+    GArray *checkpoints;    // guint64 offset of every VIEWER_INDEX_STRIDE-th line start
+    gint64 total_lines;     // Line starts found so far
+    gboolean index_done;
+    gint cancelled;
+    GThread *indexer;
+    guint poll_source;
+
+    // Window of lines currently paged into the buffer
+    GtkTextBuffer *buffer;
+    GtkAdjustment *adjustment;
+    gint64 first_line;
+    gint window_lines;
+
+    guint render_source;
+
+    // Last query, and the match it showed; next/previous continue from there
+    gchar *needle;
+    gboolean match_case;
+    GRegex *regex;
+    gssize match_offset;    // -1 once the cursor has been moved elsewhere
+    gboolean placing_match;
+    GCancellable *search_cancellable;
+} Viewer;
+
+typedef struct {
+    GMappedFile *mapped;
+    gchar *needle;
+    gboolean match_case;
+    GRegex *regex;
+    gsize from;             // Forward searches start here, backward ones end before it
+    gboolean backward;
+    gsize match_length;     // Bytes, written by the worker alongside its result
+} ViewerSearch;
+
+static Viewer *viewer = NULL;
+
+static void publish_index(Viewer *view, GArray *batch, gint64 lines) {
+    g_mutex_lock(&view->lock);
+    g_array_append_vals(view->checkpoints, batch->data, batch->len);
+    view->total_lines = lines;
+    g_mutex_unlock(&view->lock);
+    g_array_set_size(batch, 0);
+}
+
+static gpointer index_lines(gpointer data) {
+    Viewer *view = data;
+    const gchar *p = view->data;
+    const gchar *end = view->data + view->size;
+    GArray *batch = g_array_new(FALSE, FALSE, sizeof(guint64));
+    gint64 lines = 1;
+
+    while (p < end && !g_atomic_int_get(&view->cancelled)) {
+        const gchar *newline = memchr(p, '\n', end - p);
+        if (!newline) {
+            break;
+        }
+        p = newline + 1;
+        if (lines % VIEWER_INDEX_STRIDE == 0) {
+            guint64 offset = p - view->data;
+            g_array_append_val(batch, offset);
+        }
+        lines++;
+        if (lines % VIEWER_PUBLISH_LINES == 0) {
+            publish_index(view, batch, lines);
+        }
+    }
+
+    publish_index(view, batch, lines);
+    g_mutex_lock(&view->lock);
+    view->index_done = TRUE;
+    g_mutex_unlock(&view->lock);
+    g_array_unref(batch);
+    return NULL;
+}
+
+static gint64 indexed_lines(gboolean *done) {
+    g_mutex_lock(&viewer->lock);
+    gint64 lines = viewer->total_lines;
+    if (done) {
+        *done = viewer->index_done;
+    }
+    g_mutex_unlock(&viewer->lock);
+    return lines;
+}
+
+// Offset of the first byte of a line, walking forward from the nearest checkpoint
+static gsize line_start(gint64 line) {
+    g_mutex_lock(&viewer->lock);
+    guint index = MIN(line / VIEWER_INDEX_STRIDE, viewer->checkpoints->len - 1);
+    gsize offset = g_array_index(viewer->checkpoints, guint64, index);
+    g_mutex_unlock(&viewer->lock);
+
+    const gchar *p = viewer->data + offset;
+    const gchar *end = viewer->data + viewer->size;
+    for (gint64 remaining = line - (gint64) index * VIEWER_INDEX_STRIDE; remaining > 0 && p < end; remaining--) {
+        const gchar *newline = memchr(p, '\n', end - p);
+        p = newline ? newline + 1 : end;
+    }
+    return p - viewer->data;
+}
+
+static gint64 line_of_offset(gsize offset) {
+    g_mutex_lock(&viewer->lock);
+    guint low = 0, high = viewer->checkpoints->len;
+    while (high - low > 1) {
+        guint mid = (low + high) / 2;
+        if (g_array_index(viewer->checkpoints, guint64, mid) <= offset) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+    gsize checkpoint = g_array_index(viewer->checkpoints, guint64, low);
+    g_mutex_unlock(&viewer->lock);
+
+    return (gint64) low * VIEWER_INDEX_STRIDE +
+           stats_count_newlines(viewer->data + checkpoint, offset - checkpoint);
+}
+
+static void render_window(void) {
+    const gchar *end = viewer->data + viewer->size;
+    const gchar *p = viewer->data + line_start(viewer->first_line);
+    GString *text = g_string_new(NULL);
+
+    for (gint i = 0; i < viewer->window_lines && p < end; i++) {
+        const gchar *newline = memchr(p, '\n', end - p);
+        const gchar *line_end = newline ? newline : end;
+        gsize len = MIN((gsize) (line_end - p), VIEWER_MAX_LINE_BYTES);
+
+        // Cut overlong lines on a character boundary; the mapping may hold invalid UTF-8
+        while (len > 0 && p + len < line_end && (p[len] & 0xC0) == 0x80) {
+            len--;
+        }
+        gchar *valid = g_utf8_make_valid(p, len);
+        if (i > 0) {
+            g_string_append_c(text, '\n');
+        }
+        g_string_append(text, valid);
+        g_free(valid);
+
+        p = newline ? newline + 1 : end;
+    }
+
+    gtk_text_buffer_set_text(viewer->buffer, text->str, text->len);
+    g_string_free(text, TRUE);
+    editor->gutter_line_offset = viewer->first_line;
+    schedule_refresh(REFRESH_STATUS | REFRESH_GUTTER);
+}
+
+static gboolean on_render_idle(gpointer data) {
+    viewer->render_source = 0;
+    render_window();
+    return G_SOURCE_REMOVE;
+}
+
+static void update_adjustment(gint64 total_lines) {
+    gtk_adjustment_configure(viewer->adjustment,
+                             gtk_adjustment_get_value(viewer->adjustment),
+                             0, MAX(total_lines, gtk_adjustment_get_upper(viewer->adjustment)),
+                             1, MAX(viewer->window_lines - 1, 1), viewer->window_lines);
+}
+
+static void on_viewer_value_changed(GtkAdjustment *adjustment, gpointer data) {
+    gint64 first_line = (gint64) gtk_adjustment_get_value(adjustment);
+    if (first_line != viewer->first_line) {
+        viewer->first_line = first_line;
+        render_window();
+    }
+}
+
+static gboolean on_index_poll(gpointer data) {
+    gboolean done;
+    gint64 lines = indexed_lines(&done);
+
+    update_adjustment(lines);
+    schedule_refresh(REFRESH_STATUS | REFRESH_GUTTER);
+    if (done) {
+        viewer->poll_source = 0;
+        return G_SOURCE_REMOVE;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static void on_viewer_size_allocate(GtkWidget *widget, GdkRectangle *allocation, gpointer data) {
+    if (!viewer) {
+        return;
+    }
+
+    PangoLayout *layout = gtk_widget_create_pango_layout(widget, "0");
+    gint line_height;
+    pango_layout_get_pixel_size(layout, NULL, &line_height);
+    g_object_unref(layout);
+
+    gint window_lines = MAX(allocation->height / MAX(line_height, 1) + 1, 1);
+    if (window_lines != viewer->window_lines) {
+        viewer->window_lines = window_lines;
+        update_adjustment(indexed_lines(NULL));
+
+        // Repaging changes the buffer, which must not happen in the middle of an allocation
+        if (!viewer->render_source) {
+            viewer->render_source = g_idle_add(on_render_idle, NULL);
+        }
+    }
+}
+
+static void on_viewer_mark_set(GtkTextBuffer *buffer, GtkTextIter *location, GtkTextMark *mark, gpointer data) {
+    if (mark == gtk_text_buffer_get_insert(buffer)) {
+        // A cursor the user moved becomes the starting point of the next search
+        if (!viewer->placing_match) {
+            viewer->match_offset = -1;
+        }
+        schedule_refresh(REFRESH_STATUS);
+    }
+}
+
+static void scroll_lines(gdouble delta) {
+    gdouble value = gtk_adjustment_get_value(viewer->adjustment) + delta;
+    gtk_adjustment_set_value(viewer->adjustment, value);
+}
+
+static gboolean on_viewer_scroll(GtkWidget *widget, GdkEventScroll *event, gpointer data) {
+    gdouble dx, dy;
+
+    if (!viewer || (event->state & GDK_CONTROL_MASK)) {
+        return FALSE;
+    }
+    switch (event->direction) {
+        case GDK_SCROLL_UP:
+            scroll_lines(-3);
+            return TRUE;
+        case GDK_SCROLL_DOWN:
+            scroll_lines(3);
+            return TRUE;
+        case GDK_SCROLL_SMOOTH:
+            gdk_event_get_scroll_deltas((GdkEvent *) event, &dx, &dy);
+            if (dy == 0) {
+                return FALSE;
+            }
+            scroll_lines(dy * 3);
+            return TRUE;
+        default:
+            return FALSE;
+    }
+}
+
+static gboolean on_viewer_key_press(GtkWidget *widget, GdkEventKey *event, gpointer data) {
+    if (!viewer) {
+        return FALSE;
+    }
+    gdouble page = gtk_adjustment_get_page_increment(viewer->adjustment);
+    gboolean control = (event->state & GDK_CONTROL_MASK) != 0;
+
+    switch (event->keyval) {
+        case GDK_KEY_Up:
+            scroll_lines(-1);
+            return TRUE;
+        case GDK_KEY_Down:
+            scroll_lines(1);
+            return TRUE;
+        case GDK_KEY_Page_Up:
+            scroll_lines(-page);
+            return TRUE;
+        case GDK_KEY_Page_Down:
+            scroll_lines(page);
+            return TRUE;
+        case GDK_KEY_Home:
+            if (control) {
+                gtk_adjustment_set_value(viewer->adjustment, 0);
+                return TRUE;
+            }
+            return FALSE;
+        case GDK_KEY_End:
+            if (control) {
+                gtk_adjustment_set_value(viewer->adjustment, gtk_adjustment_get_upper(viewer->adjustment));
+                return TRUE;
+            }
+            return FALSE;
+        default:
+            return FALSE;
+    }
+}
+
+gboolean viewer_is_active(void) {
+    return viewer != NULL;
+}
+
+gint64 viewer_line_count(void) {
+    return viewer ? indexed_lines(NULL) : 0;
+}
+
+gboolean viewer_open(const gchar *filename, GError **error) {
+    GMappedFile *mapped = g_mapped_file_new(filename, FALSE, error);
+    if (!mapped) {
+        return FALSE;
+    }
+
+    viewer_close();
+    cancel_file_load();
+    gtk_text_buffer_set_text(editor->buffer, "", 0);
+
+    viewer = g_new0(Viewer, 1);
+    viewer->filename = g_strdup(filename);
+    viewer->mapped = mapped;
+    viewer->data = g_mapped_file_get_contents(mapped);
+    viewer->size = g_mapped_file_get_length(mapped);
+    viewer->checkpoints = g_array_new(FALSE, FALSE, sizeof(guint64));
+    guint64 zero = 0;
+    g_array_append_val(viewer->checkpoints, zero);
+    viewer->total_lines = 1;
+    viewer->match_offset = -1;
+    g_mutex_init(&viewer->lock);
+
+    viewer->buffer = gtk_text_buffer_new(NULL);
+    g_signal_connect(viewer->buffer, "mark-set", G_CALLBACK(on_viewer_mark_set), NULL);
+    viewer->adjustment = gtk_adjustment_new(0, 0, 1, 1, 1, 1);
+    g_object_ref_sink(viewer->adjustment);
+    g_signal_connect(viewer->adjustment, "value-changed", G_CALLBACK(on_viewer_value_changed), NULL);
+
+    // Swap the paged buffer into the view and let the external scrollbar drive it
+    GtkTextView *view = GTK_TEXT_VIEW(editor->text_view);
+    GtkWidget *scrolled = gtk_widget_get_parent(editor->text_view);
+    gtk_text_view_set_buffer(view, viewer->buffer);
+    gtk_text_view_set_editable(view, FALSE);
+    gtk_text_view_set_cursor_visible(view, FALSE);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled), GTK_POLICY_AUTOMATIC, GTK_POLICY_EXTERNAL);
+    gtk_range_set_adjustment(GTK_RANGE(editor->viewer_scrollbar), viewer->adjustment);
+    gtk_widget_show(editor->viewer_scrollbar);
+
+    g_free(editor->current_file);
+    editor->current_file = g_strdup(filename);
+    editor->is_modified = FALSE;
+    editor->unloaded = FALSE;
+
+    viewer->indexer = g_thread_new("line-index", index_lines, viewer);
+    viewer->poll_source = g_timeout_add(100, on_index_poll, NULL);
+
+    GtkAllocation allocation;
+    gtk_widget_get_allocation(editor->text_view, &allocation);
+    on_viewer_size_allocate(editor->text_view, &allocation, NULL);
+    schedule_refresh(REFRESH_ALL);
+    return TRUE;
+}
+
+void viewer_close(void) {
+    if (!viewer) {
+        return;
+    }
+
+    if (viewer->search_cancellable) {
+        g_cancellable_cancel(viewer->search_cancellable);
+        g_object_unref(viewer->search_cancellable);
+    }
+    if (viewer->regex) {
+        g_regex_unref(viewer->regex);
+    }
+    g_free(viewer->needle);
+    g_atomic_int_set(&viewer->cancelled, TRUE);
+    g_thread_join(viewer->indexer);
+    if (viewer->poll_source) {
+        g_source_remove(viewer->poll_source);
+    }
+    if (viewer->render_source) {
+        g_source_remove(viewer->render_source);
+    }
+
+    GtkTextView *view = GTK_TEXT_VIEW(editor->text_view);
+    GtkWidget *scrolled = gtk_widget_get_parent(editor->text_view);
+    gtk_text_view_set_buffer(view, editor->buffer);
+    gtk_text_view_set_editable(view, TRUE);
+    gtk_text_view_set_cursor_visible(view, TRUE);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+    gtk_widget_hide(editor->viewer_scrollbar);
+    editor->gutter_line_offset = 0;
+
+    g_object_unref(viewer->adjustment);
+    g_object_unref(viewer->buffer);
+    g_array_unref(viewer->checkpoints);
+    g_mutex_clear(&viewer->lock);
+    g_mapped_file_unref(viewer->mapped);
+    g_free(viewer->filename);
+    g_free(viewer);
+    viewer = NULL;
+
+    schedule_refresh(REFRESH_ALL);
+}
+
+void viewer_goto_line(gint64 line) {
+    gtk_adjustment_set_upper(viewer->adjustment,
+                             MAX(gtk_adjustment_get_upper(viewer->adjustment), line + viewer->window_lines));
+    gtk_adjustment_set_value(viewer->adjustment, MAX(line - viewer->window_lines / 4, 0));
+
+    GtkTextIter iter;
+    gtk_text_buffer_get_iter_at_line(viewer->buffer, &iter, line - viewer->first_line);
+    gtk_text_buffer_place_cursor(viewer->buffer, &iter);
+}
+
+// A regex block of about VIEWER_SEARCH_BLOCK bytes, extended to the next line break unless the line is
+// longer than another whole block, so matches do not span blocks
+static gsize regex_block_length(const gchar *data, gsize size, gsize offset) {
+    gsize len = MIN(VIEWER_SEARCH_BLOCK, size - offset);
+    const gchar *newline = memchr(data + offset + len, '\n', MIN(VIEWER_SEARCH_BLOCK, size - offset - len));
+    return newline ? (gsize) (newline + 1 - (data + offset)) : len;
+}
+
+// First match starting in [from, to), or -1
+static gssize find_first(ViewerSearch *search, const gchar *data, gsize size, gsize from, gsize to,
+                         GCancellable *cancellable, GError **error) {
+    if (search->regex) {
+        // Begin at the start of the line, so anchors and lookbehinds see the text before from
+        gsize offset = from;
+        while (offset > 0 && from - offset < VIEWER_SEARCH_BLOCK && data[offset - 1] != '\n') {
+            offset--;
+        }
+        for (gsize start = from - offset; offset < to; start = 0) {
+            if (g_cancellable_set_error_if_cancelled(cancellable, error)) {
+                return -1;
+            }
+            gsize len = regex_block_length(data, size, offset);
+            GMatchInfo *info = NULL;
+            GError *match_error = NULL;
+            gint match_start, match_end;
+            if (g_regex_match_full(search->regex, data + offset, len, start, 0, &info, &match_error) &&
+                g_match_info_fetch_pos(info, 0, &match_start, &match_end)) {
+                g_match_info_free(info);
+                search->match_length = match_end - match_start;
+                return offset + match_start < to ? (gssize) (offset + match_start) : -1;
+            }
+            g_match_info_free(info);
+            if (match_error) {
+                g_propagate_error(error, match_error);
+                return -1;
+            }
+            offset += len;
+        }
+        return -1;
+    }
+
+    // Blocks overlap by needle_len - 1 so cancellation stays responsive
+    gsize needle_len = strlen(search->needle);
+    for (gsize offset = from; offset < to && offset + needle_len <= size; offset += VIEWER_SEARCH_BLOCK) {
+        if (g_cancellable_set_error_if_cancelled(cancellable, error)) {
+            return -1;
+        }
+        gsize len = MIN(MIN(VIEWER_SEARCH_BLOCK, to - offset) + needle_len - 1, size - offset);
+        const gchar *match = search_find(data + offset, len, search->needle, needle_len, search->match_case);
+        if (match) {
+            search->match_length = needle_len;
+            return match - data;
+        }
+    }
+    return -1;
+}
+
+// Last match starting in [from, to), or -1; blocks are scanned from to downwards
+static gssize find_last(ViewerSearch *search, const gchar *data, gsize size, gsize from, gsize to,
+                        GCancellable *cancellable, GError **error) {
+    if (search->regex) {
+        // End at the line break after to, so a match starting just before it is complete
+        const gchar *newline = memchr(data + to, '\n', MIN(VIEWER_SEARCH_BLOCK, size - to));
+        gsize high = newline ? (gsize) (newline + 1 - data) : MIN(to + VIEWER_SEARCH_BLOCK, size);
+
+        while (high > from) {
+            if (g_cancellable_set_error_if_cancelled(cancellable, error)) {
+                return -1;
+            }
+            // Start the block on a line, unless the line is longer than the whole block
+            gsize low = high > VIEWER_SEARCH_BLOCK ? high - VIEWER_SEARCH_BLOCK : 0;
+            if (low > 0 && (newline = memchr(data + low, '\n', high - 1 - low)) != NULL) {
+                low = newline + 1 - data;
+            }
+
+            GMatchInfo *info = NULL;
+            GError *match_error = NULL;
+            gssize last = -1;
+            gint match_start, match_end;
+            g_regex_match_full(search->regex, data + low, high - low, MAX(from, low) - low, 0, &info, &match_error);
+            while (!match_error && g_match_info_matches(info) &&
+                   g_match_info_fetch_pos(info, 0, &match_start, &match_end) && low + match_start < to) {
+                last = low + match_start;
+                search->match_length = match_end - match_start;
+                g_match_info_next(info, &match_error);
+            }
+            g_match_info_free(info);
+            if (match_error) {
+                g_propagate_error(error, match_error);
+                return -1;
+            }
+            if (last >= 0) {
+                return last;
+            }
+            high = low;
+        }
+        return -1;
+    }
+
+    gsize needle_len = strlen(search->needle);
+    for (gsize high = to; high > from;) {
+        if (g_cancellable_set_error_if_cancelled(cancellable, error)) {
+            return -1;
+        }
+        gsize low = high - MIN(VIEWER_SEARCH_BLOCK, high - from);
+        const gchar *end = data + low + MIN(high - low + needle_len - 1, size - low);
+        const gchar *last = NULL, *match;
+        for (const gchar *p = data + low; p < end; p = match + 1) {
+            if (!(match = search_find(p, end - p, search->needle, needle_len, search->match_case))) {
+                break;
+            }
+            last = match;
+        }
+        if (last) {
+            search->match_length = needle_len;
+            return last - data;
+        }
+        high = low;
+    }
+    return -1;
+}
+
+// Searches away from the starting point, wrapping around the end of the file
+static void search_mapped(GTask *task, gpointer source, gpointer task_data, GCancellable *cancellable) {
+    ViewerSearch *search = task_data;
+    const gchar *data = g_mapped_file_get_contents(search->mapped);
+    gsize size = g_mapped_file_get_length(search->mapped);
+    gsize from = MIN(search->from, size);
+    GError *error = NULL;
+    gssize offset;
+
+    if (search->backward) {
+        offset = find_last(search, data, size, 0, from, cancellable, &error);
+        if (offset < 0 && !error) {
+            offset = find_last(search, data, size, from, size, cancellable, &error);
+        }
+    } else {
+        offset = find_first(search, data, size, from, size, cancellable, &error);
+        if (offset < 0 && !error) {
+            offset = find_first(search, data, size, 0, from, cancellable, &error);
+        }
+    }
+    if (error) {
+        g_task_return_error(task, error);
+    } else {
+        g_task_return_int(task, offset);
+    }
+}
+
+static void free_search(gpointer data) {
+    ViewerSearch *search = data;
+    g_mapped_file_unref(search->mapped);
+    g_free(search->needle);
+    if (search->regex) {
+        g_regex_unref(search->regex);
+    }
+    g_free(search);
+}
+
+static void on_search_done(GObject *source, GAsyncResult *result, gpointer data) {
+    GCancellable *cancellable = g_task_get_cancellable(G_TASK(result));
+    GError *error = NULL;
+    gssize offset = g_task_propagate_int(G_TASK(result), &error);
+    gsize needle_len = ((ViewerSearch *) g_task_get_task_data(G_TASK(result)))->match_length;
+
+    if (error) {
+        // A failed match (e.g. PCRE's backtracking limit) is not the same as no match
+        if (!g_cancellable_is_cancelled(cancellable) && viewer) {
+            gtk_label_set_text(GTK_LABEL(editor->search_label), error->message);
+        }
+        g_error_free(error);
+        return;
+    }
+    if (g_cancellable_is_cancelled(cancellable) || !viewer) {
+        return;
+    }
+    if (offset < 0) {
+        gtk_label_set_text(GTK_LABEL(editor->search_label), "No matches");
+        return;
+    }
+
+    gint64 line = line_of_offset(offset);
+    gsize start = line_start(line);
+    viewer->match_offset = offset;
+    viewer->placing_match = TRUE;
+    viewer_goto_line(line);
+
+    // Select the match unless it sits beyond the cut-off of an overlong line
+    if (offset + needle_len - start <= VIEWER_MAX_LINE_BYTES) {
+        GtkTextIter match_start, match_end;
+        gint column = g_utf8_strlen(viewer->data + start, offset - start);
+        gtk_text_buffer_get_iter_at_line_offset(viewer->buffer, &match_start, line - viewer->first_line, column);
+        match_end = match_start;
+        gtk_text_iter_forward_chars(&match_end, g_utf8_strlen(viewer->data + offset, needle_len));
+        gtk_text_buffer_select_range(viewer->buffer, &match_start, &match_end);
+    }
+    viewer->placing_match = FALSE;
+}
+
+// Byte offset of the cursor in the mapping; approximate within lines that are not valid UTF-8
+static gsize cursor_offset(void) {
+    GtkTextIter iter;
+    gtk_text_buffer_get_iter_at_mark(viewer->buffer, &iter, gtk_text_buffer_get_insert(viewer->buffer));
+    gsize start = line_start(viewer->first_line + gtk_text_iter_get_line(&iter));
+    return MIN(start + gtk_text_iter_get_line_index(&iter), viewer->size);
+}
+
+static void start_search(gsize from, gboolean backward) {
+    if (viewer->search_cancellable) {
+        g_cancellable_cancel(viewer->search_cancellable);
+        g_object_unref(viewer->search_cancellable);
+        viewer->search_cancellable = NULL;
+    }
+    gtk_label_set_text(GTK_LABEL(editor->search_label), "");
+    if (!viewer->needle || *viewer->needle == '\0') {
+        return;
+    }
+
+    ViewerSearch *search = g_new0(ViewerSearch, 1);
+    search->mapped = g_mapped_file_ref(viewer->mapped);
+    search->needle = g_strdup(viewer->needle);
+    search->match_case = viewer->match_case;
+    search->regex = viewer->regex ? g_regex_ref(viewer->regex) : NULL;
+    search->from = from;
+    search->backward = backward;
+    viewer->search_cancellable = g_cancellable_new();
+
+    GTask *task = g_task_new(NULL, viewer->search_cancellable, on_search_done, NULL);
+    g_task_set_task_data(task, search, free_search);
+    g_task_run_in_thread(task, search_mapped);
+    g_object_unref(task);
+}
+
+// A changed query starts at the match already shown, so it stays put while it still matches
+void viewer_search(const gchar *needle, gboolean match_case, GRegex *regex) {
+    g_free(viewer->needle);
+    viewer->needle = g_strdup(needle);
+    viewer->match_case = match_case;
+    if (viewer->regex) {
+        g_regex_unref(viewer->regex);
+    }
+    viewer->regex = regex ? g_regex_ref(regex) : NULL;
+    start_search(viewer->match_offset >= 0 ? (gsize) viewer->match_offset : cursor_offset(), FALSE);
+}
+
+void viewer_search_next(gboolean backward) {
+    gsize from = cursor_offset();
+    if (viewer->match_offset >= 0) {
+        from = viewer->match_offset + (backward ? 0 : 1);
+    }
+    start_search(from, backward);
+}
+
+gchar *viewer_status_text(void) {
+    gboolean done;
+    gint64 lines = indexed_lines(&done);
+    GtkTextIter iter;
+    gtk_text_buffer_get_iter_at_mark(viewer->buffer, &iter, gtk_text_buffer_get_insert(viewer->buffer));
+    gchar *size = g_format_size(viewer->size);
+
+    gchar *msg = g_strdup_printf("Line %" G_GINT64_FORMAT "/%" G_GINT64_FORMAT "%s • %s • read-only",
+                                 viewer->first_line + gtk_text_iter_get_line(&iter) + 1,
+                                 lines, done ? "" : "+ (indexing)", size);
+    g_free(size);
+    return msg;
+}
+
+void setup_viewer(void) {
+    g_signal_connect(editor->text_view, "scroll-event", G_CALLBACK(on_viewer_scroll), NULL);
+    g_signal_connect(editor->text_view, "key-press-event", G_CALLBACK(on_viewer_key_press), NULL);
+    g_signal_connect(editor->text_view, "size-allocate", G_CALLBACK(on_viewer_size_allocate), NULL);
+}